@@ -0,0 +1,157 @@
+#include "HistogramAccumulator.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+const int HISTOGRAM_TILES = (HISTOGRAM_SAMPLES + HISTOGRAM_TILE_SAMPLES - 1) / HISTOGRAM_TILE_SAMPLES;
+
+
+HistogramAccumulator::HistogramAccumulator() : tiles(HISTOGRAM_TILES) {}
+
+void HistogramAccumulator::add(int band, int histogram_index, double energy) {
+    std::unique_ptr<Tile> &tile = tiles[histogram_index / HISTOGRAM_TILE_SAMPLES];
+
+    if (!tile) {
+        tile = std::make_unique<Tile>();
+        for (auto &tileBand : *tile) {
+            tileBand.fill(0.0);
+        }
+    }
+
+    (*tile)[band][histogram_index % HISTOGRAM_TILE_SAMPLES] += energy;
+    band_totals[band] += energy;
+}
+
+void HistogramAccumulator::add(HistogramAccumulator &&other) {
+    for (int tile_i = 0; tile_i < HISTOGRAM_TILES; tile_i++) {
+        std::unique_ptr<Tile> &otherTile = other.tiles[tile_i];
+
+        if (!otherTile) {
+            continue;
+        }
+
+        if (!tiles[tile_i]) {
+            tiles[tile_i] = std::move(otherTile);
+            continue;
+        }
+
+        for (int band = 0; band < N_BANDS; band++) {
+            for (int i = 0; i < HISTOGRAM_TILE_SAMPLES; i++) {
+                (*tiles[tile_i])[band][i] += (*otherTile)[band][i];
+            }
+        }
+    }
+
+    rays_through_receiver += other.rays_through_receiver;
+    for (int band = 0; band < N_BANDS; band++) {
+        band_totals[band] += other.band_totals[band];
+    }
+}
+
+HistogramReduction::HistogramReduction(int chunks) : chunks(std::max(chunks, 1)), leaves(1) {
+    while (leaves < this->chunks) {
+        leaves *= 2;
+    }
+}
+
+void HistogramReduction::add(int chunk, HistogramAccumulator &&accumulator) {
+    // heap layout, node 1 is the root and the leaves start at index leaves
+    int node = leaves + chunk;
+    HistogramAccumulator current = std::move(accumulator);
+
+    while (node > 1) {
+        int sibling = node ^ 1;
+
+        // leftmost leaf below the sibling, padding subtrees without chunks count as done and empty
+        int sibling_leaf = sibling;
+        while (sibling_leaf < leaves) {
+            sibling_leaf *= 2;
+        }
+
+        if (sibling_leaf - leaves < chunks) {
+            std::unique_lock<std::mutex> lock(mutex);
+            auto found = pending.find(sibling);
+
+            if (found == pending.end()) {
+                pending.emplace(node, std::move(current));
+                return;
+            }
+
+            HistogramAccumulator siblingAccumulator = std::move(found->second);
+            pending.erase(found);
+            lock.unlock();
+
+            // always left + right, whichever child finished last
+            if (sibling < node) {
+                siblingAccumulator.add(std::move(current));
+                current = std::move(siblingAccumulator);
+            } else {
+                current.add(std::move(siblingAccumulator));
+            }
+        }
+
+        node /= 2;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.emplace(1, std::move(current));
+}
+
+HistogramAccumulator &HistogramReduction::result() {
+    // nothing was traced
+    if (pending.find(1) == pending.end()) {
+        pending.emplace(1, HistogramAccumulator{});
+    }
+
+    return pending.at(1);
+}
+
+void BandStatistics::add(const std::array<double, N_BANDS> &totals) {
+    count++;
+
+    for (int band = 0; band < N_BANDS; band++) {
+        double delta = totals[band] - mean[band];
+        mean[band] += delta / count;
+        m2[band] += delta * (totals[band] - mean[band]);
+    }
+}
+
+double BandStatistics::relativeError() const {
+    if (count < 2) {
+        return INFINITY;
+    }
+
+    double error = 0;
+    bool received = false;
+    for (int band = 0; band < N_BANDS; band++) {
+        if (mean[band] <= 0) {
+            continue;
+        }
+
+        double standard_error = std::sqrt(m2[band] / (count - 1) / count);
+        error = std::max(error, standard_error / mean[band]);
+        received = true;
+    }
+
+    return received ? error : INFINITY;
+}
+
+void addToHistogram(Histogram &histogram, const HistogramAccumulator &accumulator) {
+    threadPool().parallelFor(0, HISTOGRAM_TILES, 1, [&](int worker, int s, int e) {
+        for (int tile_i = s; tile_i < e; tile_i++) {
+            const auto &tile = accumulator.tiles[tile_i];
+            if (!tile) {
+                continue;
+            }
+
+            int first_sample = tile_i * HISTOGRAM_TILE_SAMPLES;
+            int samples = std::min(HISTOGRAM_TILE_SAMPLES, HISTOGRAM_SAMPLES - first_sample);
+
+            for (int band = 0; band < N_BANDS; band++) {
+                for (int i = 0; i < samples; i++) {
+                    histogram[band][first_sample + i] += (*tile)[band][i];
+                }
+            }
+        }
+    });
+}
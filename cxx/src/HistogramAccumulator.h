@@ -0,0 +1,61 @@
+#pragma once
+#include <array>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "settings.h"
+
+typedef std::array<std::array<double, HISTOGRAM_SAMPLES>, N_BANDS> Histogram;
+
+
+// Histogram owned by a single thread, so depositing needs no synchronisation.
+// Only the tiles of HISTOGRAM_TILE_SAMPLES samples that receive energy are allocated.
+struct HistogramAccumulator {
+    typedef std::array<std::array<double, HISTOGRAM_TILE_SAMPLES>, N_BANDS> Tile;
+
+    std::vector<std::unique_ptr<Tile>> tiles;
+    int rays_through_receiver = 0;
+    std::array<double, N_BANDS> band_totals {};
+
+    HistogramAccumulator();
+
+    void add(int band, int histogram_index, double energy);
+    void add(HistogramAccumulator &&other);
+};
+
+// Combines one accumulator per chunk of rays along a fixed binary tree over the chunk indices, so the sums do not
+// depend on which thread traced a chunk or when. A node is merged as soon as both of its children are done,
+// which keeps only a few accumulators alive at a time.
+class HistogramReduction {
+public:
+    explicit HistogramReduction(int chunks);
+
+    // thread safe, every chunk in [0, chunks) is added exactly once
+    void add(int chunk, HistogramAccumulator &&accumulator);
+
+    // sum of all chunks, only valid once every chunk has been added
+    HistogramAccumulator &result();
+
+private:
+    int chunks;
+    int leaves;
+
+    std::mutex mutex;
+    std::unordered_map<int, HistogramAccumulator> pending;
+};
+
+// Welford running mean and variance of the band totals of equally sized chunks of rays.
+struct BandStatistics {
+    int count = 0;
+    std::array<double, N_BANDS> mean {};
+    std::array<double, N_BANDS> m2 {};
+
+    void add(const std::array<double, N_BANDS> &totals);
+
+    // largest standard error of the mean relative to the mean, over the bands that received energy
+    double relativeError() const;
+};
+
+// Adds the accumulator to histogram, the tiles are split over the thread pool.
+void addToHistogram(Histogram &histogram, const HistogramAccumulator &accumulator);
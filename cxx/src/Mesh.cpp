@@ -113,11 +113,11 @@ std::vector<Mesh> loadMesh(const std::string& file)
     return out;
 }
 
-std::ostream &operator<<(std::ostream &out, const VertexTriangle &vertexTriangle) {
+std::ostream &operator<<(std::ostream &out, const SceneTriangle &sceneTriangle) {
     out << "["
-        << vertexTriangle.vertex_0.p << " "
-        << vertexTriangle.vertex_1.p << " "
-        << vertexTriangle.vertex_2.p
+        << sceneTriangle.vertex_0 << " "
+        << sceneTriangle.vertex_1 << " "
+        << sceneTriangle.vertex_2
         << "]";
 
     return out;
@@ -29,12 +29,12 @@ struct AudioReflection {
     AudioReflection(Energy &SCATTERING_COEFFICIENT, Energy &ABSORPTION_COEFFICIENT);
 };
 
-struct VertexTriangle {
-    Vertex vertex_0;
-    Vertex vertex_1;
-    Vertex vertex_2;
-    glm::vec3 planeNormal;
-    float planeD;
+// triangle positions of a mesh in world space, material is the index of the mesh it came from
+struct SceneTriangle {
+    glm::vec3 vertex_0;
+    glm::vec3 vertex_1;
+    glm::vec3 vertex_2;
+    int material;
 };
 
 struct Sphere {
@@ -42,7 +42,7 @@ struct Sphere {
     float radius;
 };
 
-std::ostream &operator<<(std::ostream &out, const VertexTriangle &vertexTriangle);
+std::ostream &operator<<(std::ostream &out, const SceneTriangle &sceneTriangle);
 
 using Triangle = glm::uvec3;
 
@@ -53,8 +53,6 @@ struct Mesh {
     // A triangle, thus, contains a triplet of values corresponding to the 3 vertices of a triangle.
     std::vector<Triangle> triangles;
 
-    std::vector<VertexTriangle> vertexTriangles;
-
     Material material;
     AudioReflection *audioReflection;
 };
@@ -1,13 +1,14 @@
 #include "Receiver.h"
 #include "config.h"
 #include <vector>
-#include <set>
+#include <atomic>
 #include <rays/RayTracing.h>
 #include <glm/geometric.hpp>
 #include <fstream>
 #include <better_assert.hpp>
-#include <thread>
+#include "ThreadPool.h"
 #include <sstream>
+#include <cmath>
 #include <boost/format.hpp>
 
 
@@ -49,10 +50,32 @@ boost::filesystem::path getAndMakeOutputPath(const HISTOGRAM_TYPE histogramType)
     return output_path;
 }
 
-void Receiver::listenToRays(std::vector<Ray> &all_rays, RaySettings &raySettings) {
+boost::filesystem::path getAndMakeOutputPath(const HISTOGRAM_TYPE histogramType, int source) {
+    return getAndMakeOutputPath(histogramType, source < 0 ? "" : "source_" + std::to_string(source));
+}
+
+boost::filesystem::path getAndMakeOutputPath(const HISTOGRAM_TYPE histogramType, const std::string &folder) {
+    boost::filesystem::path output_path = getAndMakeOutputPath(histogramType);
+
+    if (folder.empty()) {
+        return output_path;
+    }
+
+    output_path /= folder;
+    boost::filesystem::create_directories(output_path);
+
+    return output_path;
+}
+
+void Receiver::listenToRays(std::vector<Ray> &all_rays, RaySettings &raySettings, const TraceReception *traced) {
+    bool fused = traced != nullptr && traced->valid && traced->energy;
 
     if (global_config->DIFFUSE_ENERGY) {
-        addDiffuseEnergyToHistogram(all_rays, diffuse_rays, raySettings);
+        if (fused) {
+            addAccumulator(traced->diffuse);
+        } else {
+            addDiffuseEnergyToHistogram(all_rays, diffuse_rays, raySettings);
+        }
         auto output_path = getAndMakeOutputPath(DIFFUSE);
         saveToFile(output_path / "histogram.csv");
         saveSettings(output_path / "histogram.json");
@@ -62,12 +85,17 @@ void Receiver::listenToRays(std::vector<Ray> &all_rays, RaySettings &raySettings
 
 
     if (global_config->SPECULAR_ENERGY) {
-        addSpecularEnergyToHistogram(all_rays);
+        if (fused) {
+            addAccumulator(traced->specular);
+        } else {
+            addSpecularEnergyToHistogram(all_rays, raySettings);
+        }
+        addImageSourceEnergyToHistogram(raySettings, global_config->SENDER_LOCATION, raySettings.amount_of_rays);
     }
 
 }
 
-void Receiver::addEnergyToHistogram(std::vector<Ray> &all_rays, Ray &ray, float t, Energy &energy) {
+void Receiver::addEnergyToHistogram(const Ray &ray, float t, const Energy &energy, HistogramAccumulator &accumulator) {
     float total_t = ray.total_previous_t + t;
     float distance = total_t;
     double inverse_square_law_attenuation = attenuate_over_inverse_square_law(distance);
@@ -84,7 +112,8 @@ void Receiver::addEnergyToHistogram(std::vector<Ray> &all_rays, Ray &ray, float
     if (global_config->IMPORTANCE_SAMPLING && ADJUST_ENERGY_WITH_PROBABILITY) {
         probability_factor = 1.0f / ray.initNums.probability;
 
-        if (probability_factor > MAX_PROBABILITY_FACTOR) {
+        // the defensive mixture already bounds the factor, clamping would only add bias
+        if (probability_factor > MAX_PROBABILITY_FACTOR && global_config->DEFENSIVE_FRACTION <= 0) {
 
             probability_factor = MAX_PROBABILITY_FACTOR;
         }
@@ -93,55 +122,84 @@ void Receiver::addEnergyToHistogram(std::vector<Ray> &all_rays, Ray &ray, float
 
 
     for (int band = 0; band < N_BANDS; band++) {
-        (*this->histogram).at(band).at(histogram_index) += inverse_square_law_attenuation * probability_factor * energy.values[band];
+        accumulator.add(band, histogram_index, inverse_square_law_attenuation * probability_factor * energy.values[band]);
     }
 }
 
-void Receiver::addSpecularEnergyToHistogram(std::vector<Ray> &all_rays) {
-    Sphere receiverSphere {global_config->RECEIVER_LOCATION, global_config->RECEIVER_RADIUS};
+bool Receiver::receiveSpecular(const Ray &ray, HistogramAccumulator &accumulator) {
+    return receiveSpecular(Sphere {location, receiver_radius}, ray, accumulator);
+}
 
-    std::set<int> ray_received_list;
+bool Receiver::receiveSpecular(const Sphere &sphere, const Ray &ray, HistogramAccumulator &accumulator) {
+    std::optional<float> t_sphere = intersectWithSphere(sphere, ray);
 
+    if (!t_sphere.has_value()) {
+        return false;
+    }
 
-    for (int i = 0; i < all_rays.size(); i++) {
-        Ray &ray = all_rays.at(i);
+    // the image sources supply these orders exactly
+    if (ray.hit_level > global_config->IMAGE_SOURCE_ORDER) {
+        addEnergyToHistogram(ray, t_sphere.value(), ray.current_energy, accumulator);
+    }
 
-        if (i % 10000 == 0) {
-            std::cout << "\rSpecular ray: " << i << "/" << all_rays.size() << std::flush;
-        }
+    accumulator.rays_through_receiver++;
+    return true;
+}
 
-        std::optional<float> t_sphere = intersectWithSphere(receiverSphere, ray);
+void Receiver::addSpecularEnergyToHistogram(std::vector<Ray> &all_rays, const RaySettings &raySettings) {
+    int rays = (int) all_rays.size();
+    int paths = raySettings.amount_of_rays;
+    HistogramReduction reduction {(rays + RAY_CHUNK_SIZE - 1) / RAY_CHUNK_SIZE};
 
-        if (!t_sphere.has_value()) {
-            continue;
-        }
+    // one bit per path, set by every ray of the path that passes through the receiver
+    std::vector<std::atomic<uint64_t>> received_paths((paths + 63) / 64);
+    for (std::atomic<uint64_t> &word : received_paths) {
+        word.store(0, std::memory_order_relaxed);
+    }
 
-        float t = t_sphere.value();
+    std::cout << "Specular rays: " << rays << std::endl;
 
-        addEnergyToHistogram(all_rays, ray, t, ray.current_energy);
-        ray_received_list.insert(ray.ray_start_index);
-        ray.received = true;
-        rays_through_receiver++;
-    }
+    threadPool().parallelFor(0, rays, RAY_CHUNK_SIZE, [&](int worker, int s, int e) {
+        HistogramAccumulator accumulator;
 
-    std::cout << std::endl;
+        for (int i = s; i < e; i++) {
+            Ray &ray = all_rays[i];
 
-    for (Ray &ray : all_rays) {
-        if (ray_received_list.find(ray.ray_start_index) != ray_received_list.end()) {
-            ray.received_chain = true;
+            // slots no path of the last pass has reached
+            if (ray.ray_start_index < 0 || ray.ray_start_index >= paths) {
+                continue;
+            }
+
+            if (!receiveSpecular(ray, accumulator)) {
+                continue;
+            }
+
+            ray.received = true;
+            received_paths[ray.ray_start_index / 64].fetch_or(1ull << (ray.ray_start_index % 64), std::memory_order_relaxed);
         }
-    }
 
-    std::cout << "Number of rays through receiver: " << rays_through_receiver << std::endl;
+        reduction.add(s / RAY_CHUNK_SIZE, std::move(accumulator));
+    });
 
+    addAccumulator(reduction.result());
 
+    threadPool().parallelFor(0, rays, RAY_CHUNK_SIZE, [&](int worker, int s, int e) {
+        for (int i = s; i < e; i++) {
+            Ray &ray = all_rays[i];
+
+            if (ray.ray_start_index >= 0 && ray.ray_start_index < paths &&
+                (received_paths[ray.ray_start_index / 64].load(std::memory_order_relaxed) >> (ray.ray_start_index % 64)) & 1) {
+                ray.received_chain = true;
+            }
+        }
+    });
+
+    std::cout << "Number of rays through receiver: " << rays_through_receiver << std::endl;
 }
 
 
-void diffuseIteration(Receiver *self, std::vector<Ray> &all_rays, RaySettings &raySettings, int i, int block,
-                      int *ptotal_rays_done) {
-    int s = i * block;
-    int e = s + block;
+void diffuseIteration(Receiver *self, std::vector<Ray> &all_rays, RaySettings &raySettings, int s, int e,
+                      int *ptotal_rays_done, HistogramAccumulator &accumulator) {
     for (int ray_i = s; ray_i < e; ray_i++) {
 
         if (ray_i % 10000 == 0) {
@@ -153,75 +211,89 @@ void diffuseIteration(Receiver *self, std::vector<Ray> &all_rays, RaySettings &r
 
 
 
-        Ray ray = all_rays.at(ray_i);
-
-        if (ray.t >= infT) {
+        // slots no path of the last pass has reached
+        if (all_rays[ray_i].ray_start_index < 0) {
             continue;
         }
 
-        glm::vec3 intersectionPoint = ray.hitInfo.hitPoint;
-        glm::vec3 direction = glm::normalize(self->location - intersectionPoint);
+        self->receiveDiffuse(all_rays.at(ray_i), raySettings, accumulator);
+    }
 
-        Ray diffuseRay {intersectionPoint, direction};
-        detectHit(diffuseRay, raySettings);
+}
 
-        float distance_to_receiver = glm::length(self->location - intersectionPoint);
-        float diffuse_ray_t = diffuseRay.t;
+float Receiver::coneFactor(float radius, float distance) {
+    float cos_gamma_2 = radius / distance;
+    if (distance < radius) {
+        // attenuation is ignored
+        cos_gamma_2 = 1;
+    }
 
-        // ray hits object before the receiver
-        if (diffuse_ray_t < distance_to_receiver) {
-            continue;
-        }
+    return 1 - cos_gamma_2;
+}
 
-        // ray may not hit anything
-        if (diffuse_ray_t > infT) {
-            continue;
-        }
+float Receiver::diffuseFactor(const Sphere &sphere, const glm::vec3 &point, const glm::vec3 &normal) {
+    glm::vec3 direction = glm::normalize(sphere.center - point);
+    float distance_to_receiver = glm::length(sphere.center - point);
 
-        Energy &a = ray.hitInfo.hitAudioReflection->absorption_coefficient;
-        Energy &s = ray.hitInfo.hitAudioReflection->scattering_coefficient;
-        float cos_theta = glm::abs(glm::dot(direction, ray.hitInfo.hitNormal));
-        float cos_gamma_2 = self->receiver_radius / distance_to_receiver;
-        if (distance_to_receiver < self->receiver_radius) {
-            // attenuation is ignored
-            cos_gamma_2 = 1;
-        }
+    float cos_theta = glm::abs(glm::dot(direction, normal));
+
+    return coneFactor(sphere.radius, distance_to_receiver) * 2 * cos_theta;
+}
 
-        float attenuation = 1.0f;
+void Receiver::receiveDiffuse(const Ray &ray, const RaySettings &raySettings, HistogramAccumulator &accumulator) {
+    receiveDiffuse(Sphere {location, receiver_radius}, ray, raySettings, accumulator);
+}
+
+void Receiver::receiveDiffuse(const Sphere &sphere, const Ray &ray, const RaySettings &raySettings, HistogramAccumulator &accumulator) {
+    glm::vec3 location = sphere.center;
+
+    if (ray.t >= infT) {
+        return;
+    }
 
-        // from schroder,Dirk p.64 eq 5.20
-        // energy * (1 - a) * s * (1 - cos_gamma_2) * 2 * cos_theta * attenuation;
-        Energy diffuseEnergy = ray.current_energy;
-        diffuseEnergy.multiply(a.complement());
-        diffuseEnergy.multiply(s);
-        diffuseEnergy.multiply((1 - cos_gamma_2) * 2 * cos_theta * attenuation);
+    glm::vec3 intersectionPoint = ray.hitInfo.hitPoint;
 
-        self->addEnergyToHistogram(all_rays, ray, distance_to_receiver + ray.t, diffuseEnergy);
+    // ray hits object before the receiver
+    if (isOccluded(intersectionPoint, location, raySettings)) {
+        return;
     }
 
+    float distance_to_receiver = glm::length(location - intersectionPoint);
+
+    Energy &a = ray.hitInfo.hitAudioReflection->absorption_coefficient;
+    Energy &s = ray.hitInfo.hitAudioReflection->scattering_coefficient;
+    float attenuation = 1.0f;
+
+    // from schroder,Dirk p.64 eq 5.20
+    // energy * (1 - a) * s * (1 - cos_gamma_2) * 2 * cos_theta * attenuation;
+    Energy diffuseEnergy = ray.current_energy;
+    diffuseEnergy.multiply(a.complement());
+    diffuseEnergy.multiply(s);
+    diffuseEnergy.multiply(diffuseFactor(sphere, intersectionPoint, ray.hitInfo.hitNormal) * attenuation);
+
+    addEnergyToHistogram(ray, distance_to_receiver + ray.t, diffuseEnergy, accumulator);
 }
 
 
 void Receiver::addDiffuseEnergyToHistogram(std::vector<Ray> &all_rays, std::vector<Ray> &diffuse_rays, RaySettings &raySettings) {
 
-    int block = all_rays.size() / NUM_THREADS;
-    std::vector<std::thread> threads = std::vector<std::thread>();
     int total_rays_done = 0;
     int* ptotal_rays_done = &total_rays_done;
-
-    for (int i = 0; i < NUM_THREADS; i++) {
-        std::thread t(diffuseIteration, this, std::ref(all_rays), std::ref(raySettings), i, block, ptotal_rays_done);
-        threads.push_back(std::move(t));
-    }
+    int rays = (int) all_rays.size();
+    HistogramReduction reduction {(rays + RAY_CHUNK_SIZE - 1) / RAY_CHUNK_SIZE};
 
     std::cout << "\rDiffuse ray: ";
     std::cout << *ptotal_rays_done << "/" << raySettings.amount_of_rays * raySettings.max_hit_level;
 
-    for (auto& th : threads) {
-        th.join();
-    }
+    threadPool().parallelFor(0, rays, RAY_CHUNK_SIZE, [&](int worker, int s, int e) {
+        HistogramAccumulator accumulator;
+        diffuseIteration(this, all_rays, raySettings, s, e, ptotal_rays_done, accumulator);
+        reduction.add(s / RAY_CHUNK_SIZE, std::move(accumulator));
+    });
     std::cout << std::endl;
 
+    addAccumulator(reduction.result());
+
 }
 
 
@@ -264,6 +336,12 @@ void Receiver::saveSettings(boost::filesystem::path path) {
     out << "\"HISTOGRAM_SAMPLING_FREQUENCY\":" << HISTOGRAM_SAMPLING_FREQUENCY << ",";
     out << "\"HISTOGRAM_SECONDS\":" << HISTOGRAM_SECONDS << ",";
     out << "\"RAY_COUNT\":" << global_config->RAYS_CAST << ",";
+    out << "\"RAYS_TRACED\":" << (rays_traced >= 0 ? rays_traced : global_config->RAYS_CAST) << ",";
+    if (relative_error >= 0 && std::isfinite(relative_error)) {
+        out << "\"RELATIVE_ERROR\":" << relative_error << ",";
+    } else {
+        out << "\"RELATIVE_ERROR\":null,";
+    }
     out << "\"MILLISECONDS_ELAPSED\":" << milliseconds_elapsed << ",";
     out << "\"RAYS_RECEIVED_BY_SPHERE\":" << rays_through_receiver << ",";
     out << "\"IMPORTANCE_SAMPLING\":" << global_config->IMPORTANCE_SAMPLING << ",";
@@ -283,6 +361,87 @@ void Receiver::saveSettings(boost::filesystem::path path) {
     out << '\n';
 }
 
+void Receiver::addHistogram(const Receiver &other) {
+    for (int band = 0; band < N_BANDS; band++) {
+        for (int i = 0; i < HISTOGRAM_SAMPLES; i++) {
+            (*this->histogram)[band][i] += (*other.histogram)[band][i];
+        }
+    }
+
+    rays_through_receiver += other.rays_through_receiver;
+}
+
+void Receiver::addAccumulator(const HistogramAccumulator &accumulator) {
+    addToHistogram(*this->histogram, accumulator);
+    rays_through_receiver += accumulator.rays_through_receiver;
+}
+
+// mean density of the initial directions over the cap of sin_radius, equal area points on a golden angle spiral
+static double averageCapDensity(const glm::vec3 &direction, double sin_radius) {
+    glm::vec3 helper = std::abs(direction.x) < 0.9f ? glm::vec3 {1, 0, 0} : glm::vec3 {0, 1, 0};
+    glm::vec3 u = glm::normalize(glm::cross(direction, helper));
+    glm::vec3 v = glm::cross(direction, u);
+
+    double density = 0;
+    for (int i = 0; i < IMAGE_SOURCE_CAP_SAMPLES; i++) {
+        double radius = sin_radius * std::sqrt((i + 0.5) / IMAGE_SOURCE_CAP_SAMPLES);
+        double angle = i * M_PI * (3 - std::sqrt(5.0));
+        glm::vec3 offset = (float) (radius * std::cos(angle)) * u + (float) (radius * std::sin(angle)) * v;
+        density += getDirectionDensity(glm::normalize(direction + offset));
+    }
+
+    return density / IMAGE_SOURCE_CAP_SAMPLES;
+}
+
+void Receiver::receiveImageSources(const ImageSourceTree &imageSources, const RaySettings &raySettings, int rays, bool reciprocal) {
+    HistogramAccumulator accumulator;
+
+    for (const SpecularPath &path : imageSources.findPaths(location, raySettings)) {
+        // a source inside the sphere has no entry point
+        if (path.length <= receiver_radius) {
+            continue;
+        }
+
+        // fraction of the cast rays that pass through the sphere, the solid angle of its cap times the density of
+        // the initial directions, mirrors keep the solid angle of the beam.
+        // Traced forward, a reciprocal path leaves this sphere against its arrival, the reciprocal weight
+        // density(leaving the candidate) / density(leaving the receiver) cancels the density the receiver casts with
+        double ratio = receiver_radius / path.length;
+        double solid_angle = 2 * M_PI * (1 - std::sqrt(1 - ratio * ratio));
+        glm::vec3 leaving = reciprocal ? -path.arrival : path.direction;
+        double fraction = solid_angle * averageCapDensity(leaving, ratio);
+
+        // the rays deposit at the middle of their chord through the sphere, which is the center for the central ray
+        float total_t = path.length;
+        float time_elapsed = convertTToRealTime(total_t);
+        int histogram_index = (int) (time_elapsed * HISTOGRAM_SAMPLES_PER_SECOND);
+        if (histogram_index >= HISTOGRAM_SAMPLES) {
+            continue;
+        }
+
+        double energy_factor = rays * fraction * attenuate_over_inverse_square_law(total_t);
+        for (int band = 0; band < N_BANDS; band++) {
+            accumulator.add(band, histogram_index, energy_factor * path.energy.values[band]);
+        }
+    }
+
+    addAccumulator(accumulator);
+}
+
+void Receiver::addImageSourceEnergyToHistogram(RaySettings &raySettings, const glm::vec3 &source, int rays) {
+    if (global_config->IMAGE_SOURCE_ORDER < 0) {
+        return;
+    }
+
+    // the first image is the sender itself
+    if (imageSources.images.empty() || imageSources.images.front().position != source) {
+        imageSources.build(raySettings, source, global_config->IMAGE_SOURCE_ORDER);
+        std::cout << "Image sources: " << imageSources.images.size() << " over " << raySettings.walls.size() << " walls" << std::endl;
+    }
+
+    receiveImageSources(imageSources, raySettings, rays);
+}
+
 double Receiver::attenuate_over_inverse_square_law(float distance) {
     return 1.0 / (distance*distance);
 }
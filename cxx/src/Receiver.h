@@ -1,8 +1,12 @@
+#pragma once
 
 #include <vector>
 #include <glm/vec3.hpp>
 #include <rays/Ray.h>
 #include "settings.h"
+#include "HistogramAccumulator.h"
+#include "TraceReception.h"
+#include <rays/ImageSource.h>
 
 struct Receiver {
 
@@ -12,9 +16,30 @@ struct Receiver {
 
     float receiver_radius{};
 
-    void addEnergyToHistogram(std::vector<Ray> &all_rays, Ray &ray, float t, Energy &energy);
+    static void addEnergyToHistogram(const Ray &ray, float t, const Energy &energy, HistogramAccumulator &accumulator);
 
-    void addSpecularEnergyToHistogram(std::vector<Ray> &all_rays);
+    void addSpecularEnergyToHistogram(std::vector<Ray> &all_rays, const RaySettings &raySettings);
+
+    // energy of a ray segment passing through the receiver sphere, false when it misses the sphere
+    bool receiveSpecular(const Ray &ray, HistogramAccumulator &accumulator);
+    static bool receiveSpecular(const Sphere &sphere, const Ray &ray, HistogramAccumulator &accumulator);
+
+    // energy scattered from the hit point of the ray towards the receiver
+    void receiveDiffuse(const Ray &ray, const RaySettings &raySettings, HistogramAccumulator &accumulator);
+    static void receiveDiffuse(const Sphere &sphere, const Ray &ray, const RaySettings &raySettings, HistogramAccumulator &accumulator);
+
+    // (1 - cos_gamma_2) * 2 * cos_theta, the share of the energy scattered at point that reaches the sphere
+    static float diffuseFactor(const Sphere &sphere, const glm::vec3 &point, const glm::vec3 &normal);
+    // 1 - cos_gamma_2 of a sphere of radius at distance, 0 from inside
+    static float coneFactor(float radius, float distance);
+
+    void addHistogram(const Receiver &other);
+
+    void addAccumulator(const HistogramAccumulator &accumulator);
+
+    // the image source paths, weighted as the sphere would receive them on average from rays rays.
+    // reciprocal when the tree was built at the receiver of a reciprocal run and this sphere is a candidate source
+    void receiveImageSources(const ImageSourceTree &imageSources, const RaySettings &raySettings, int rays, bool reciprocal = false);
 
 public:
 
@@ -22,20 +47,39 @@ public:
         this->location = location;
         this->receiver_radius = receiver_radius;
         std::cout << "creating histogram" << std::flush;
-        this->histogram = new std::array<std::array<double, HISTOGRAM_SAMPLES>, N_BANDS>({0.0f});
+        this->histogram = new Histogram({0.0f});
         std::cout << "\rhistogram created" << std::endl;
     }
 
-    void listenToRays(std::vector<Ray> &all_rays, RaySettings &raySettings);
-    std::array<std::array<double, HISTOGRAM_SAMPLES>, N_BANDS>* histogram;
+    // one histogram per receiver, which are created per candidate source
+    ~Receiver() {
+        delete histogram;
+    }
+
+    Receiver(const Receiver &) = delete;
+    Receiver &operator=(const Receiver &) = delete;
+
+    // takes the energy from traced when it gathered it on the last pass, sweeps all_rays otherwise
+    void listenToRays(std::vector<Ray> &all_rays, RaySettings &raySettings, const TraceReception *traced = nullptr);
+    void addImageSourceEnergyToHistogram(RaySettings &raySettings, const glm::vec3 &source, int rays);
+    Histogram* histogram;
 
     std::vector<Ray> diffuse_rays;
     glm::vec3 location{};
 
+    // filled by the stored pipeline while tracing when FUSED_RECEPTION is on
+    TraceReception traced;
+
+    // set by progressive streaming, RAYS_CAST and unknown otherwise
+    int rays_traced = -1;
+    double relative_error = -1;
+
 
 private:
 
     int rays_through_receiver = 0;
+    // the images of the last sender of the stored pipeline, rebuilt only when the sender moves
+    ImageSourceTree imageSources;
     static float convertTToRealTime(float t);
 
     void addDiffuseEnergyToHistogram(std::vector<Ray> &all_rays, std::vector<Ray> &diffuse_rays, RaySettings &raySettings);
@@ -49,6 +93,10 @@ enum HISTOGRAM_TYPE {
 };
 
 
-void diffuseIteration(Receiver *self, std::vector<Ray> &all_rays, RaySettings &raySettings, int i, int block, int* ptotal_rays_done);
+void diffuseIteration(Receiver *self, std::vector<Ray> &all_rays, RaySettings &raySettings, int s, int e, int* ptotal_rays_done, HistogramAccumulator &accumulator);
 boost::filesystem::path getAndMakeOutputPath(const HISTOGRAM_TYPE histogramType);
+// a folder per candidate source below the output path, the output path itself for source -1
+boost::filesystem::path getAndMakeOutputPath(const HISTOGRAM_TYPE histogramType, int source);
+// folder below the output path, the output path itself for an empty folder
+boost::filesystem::path getAndMakeOutputPath(const HISTOGRAM_TYPE histogramType, const std::string &folder);
 
@@ -0,0 +1,121 @@
+#include "ReceiverSet.h"
+#include "Receiver.h"
+#include "ThreadPool.h"
+#include <glm/geometric.hpp>
+#include <algorithm>
+#include <cmath>
+
+
+// crossing number test of the point (x, y) against the polygon xs, ys
+static bool insidePolygon(const std::vector<float> &xs, const std::vector<float> &ys, float x, float y) {
+    bool inside = false;
+
+    for (int i = 0, j = (int) xs.size() - 1; i < xs.size(); j = i++) {
+        if ((ys[i] > y) != (ys[j] > y) && x < (xs[j] - xs[i]) * (y - ys[i]) / (ys[j] - ys[i]) + xs[i]) {
+            inside = !inside;
+        }
+    }
+
+    return inside;
+}
+
+std::vector<glm::vec3> seatsInPolygon(const std::vector<glm::vec3> &polygon, float spacing, float height) {
+    std::vector<glm::vec3> seats;
+    int n = (int) polygon.size();
+
+    if (n < 3 || spacing <= 0) {
+        return seats;
+    }
+
+    // Newell's method, also fine for slightly non planar polygons
+    glm::vec3 normal {0.0f};
+    for (int i = 0; i < n; i++) {
+        const glm::vec3 &a = polygon[i];
+        const glm::vec3 &b = polygon[(i + 1) % n];
+        normal.x += (a.y - b.y) * (a.z + b.z);
+        normal.y += (a.z - b.z) * (a.x + b.x);
+        normal.z += (a.x - b.x) * (a.y + b.y);
+    }
+    normal = glm::normalize(normal);
+
+    glm::vec3 u = glm::normalize(polygon[1] - polygon[0]);
+    glm::vec3 v = glm::cross(normal, u);
+
+    std::vector<float> xs(n);
+    std::vector<float> ys(n);
+    for (int i = 0; i < n; i++) {
+        xs[i] = glm::dot(polygon[i] - polygon[0], u);
+        ys[i] = glm::dot(polygon[i] - polygon[0], v);
+    }
+
+    float min_x = *std::min_element(xs.begin(), xs.end());
+    float min_y = *std::min_element(ys.begin(), ys.end());
+    int columns = (int) std::ceil((*std::max_element(xs.begin(), xs.end()) - min_x) / spacing);
+    int rows = (int) std::ceil((*std::max_element(ys.begin(), ys.end()) - min_y) / spacing);
+
+    // seats sit in the middle of the cells of the grid
+    for (int row = 0; row < rows; row++) {
+        for (int column = 0; column < columns; column++) {
+            float x = min_x + (column + 0.5f) * spacing;
+            float y = min_y + (row + 0.5f) * spacing;
+
+            if (insidePolygon(xs, ys, x, y)) {
+                seats.push_back(polygon[0] + u * x + v * y + normal * height);
+            }
+        }
+    }
+
+    return seats;
+}
+
+void ReceiverSet::build(const std::vector<glm::vec3> &locations, float radius, bool specular_energy, bool diffuse_energy) {
+    seats.build(locations, radius);
+    specular.clear();
+    diffuse.clear();
+    specular.resize(specular_energy ? locations.size() : 0);
+    diffuse.resize(diffuse_energy ? locations.size() : 0);
+}
+
+void ReceiverSet::receive(const std::vector<std::vector<Ray>> &chunkSegments, const std::vector<std::vector<std::pair<int, int>>> &chunkHits,
+                          const RaySettings &raySettings) {
+    // counting sort of the hits by seat, stable so every seat sees its segments in trace order
+    std::vector<int> seat_start(size() + 1, 0);
+    for (const std::vector<std::pair<int, int>> &hits : chunkHits) {
+        for (const std::pair<int, int> &hit : hits) {
+            seat_start[hit.first + 1]++;
+        }
+    }
+
+    for (int seat = 0; seat < size(); seat++) {
+        seat_start[seat + 1] += seat_start[seat];
+    }
+
+    // the segments through each seat as pointers into the chunks
+    std::vector<const Ray *> seat_segments(seat_start[size()]);
+    std::vector<int> fill(seat_start.begin(), seat_start.end() - 1);
+    for (int chunk = 0; chunk < chunkHits.size(); chunk++) {
+        for (const std::pair<int, int> &hit : chunkHits[chunk]) {
+            seat_segments[fill[hit.first]++] = &chunkSegments[chunk][hit.second];
+        }
+    }
+
+    threadPool().parallelFor(0, size(), 1, [&](int worker, int s, int e) {
+        for (int seat = s; seat < e; seat++) {
+            Sphere sphere = seats.sphere(seat);
+
+            if (!specular.empty()) {
+                for (int i = seat_start[seat]; i < seat_start[seat + 1]; i++) {
+                    Receiver::receiveSpecular(sphere, *seat_segments[i], specular[seat]);
+                }
+            }
+
+            if (!diffuse.empty()) {
+                for (const std::vector<Ray> &segments : chunkSegments) {
+                    for (const Ray &segment : segments) {
+                        Receiver::receiveDiffuse(sphere, segment, raySettings, diffuse[seat]);
+                    }
+                }
+            }
+        }
+    });
+}
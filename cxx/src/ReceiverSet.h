@@ -0,0 +1,32 @@
+#pragma once
+#include <vector>
+#include <glm/vec3.hpp>
+#include <rays/Ray.h>
+#include <rays/SphereGrid.h>
+#include "HistogramAccumulator.h"
+
+
+// Seats on a grid over the audience polygon, spacing apart and lifted height along its normal.
+// The normal points to the side the vertices run counter clockwise around.
+std::vector<glm::vec3> seatsInPolygon(const std::vector<glm::vec3> &polygon, float spacing, float height);
+
+// Many receiver spheres of one radius, indexed by a SphereGrid so a ray segment only tests the seats next to it.
+// Every seat owns its accumulators, so the seats can be scored in parallel without synchronisation.
+struct ReceiverSet {
+    SphereGrid seats;
+    // one per seat, empty when that energy is not wanted
+    std::vector<HistogramAccumulator> specular;
+    std::vector<HistogramAccumulator> diffuse;
+
+    void build(const std::vector<glm::vec3> &locations, float radius, bool specular_energy, bool diffuse_energy);
+
+    int size() const {
+        return (int) seats.centers.size();
+    }
+
+    // Scores a batch of traced segments seat by seat, the segments stay in the chunks that traced them. chunkHits are the
+    // (seat, segment) pairs of the segments of each chunk through a seat in segment order, every seat gets the diffuse
+    // energy of all segments towards it. The chunks are visited in order, so the sums do not depend on the scheduling.
+    void receive(const std::vector<std::vector<Ray>> &chunkSegments, const std::vector<std::vector<std::pair<int, int>>> &chunkHits,
+                 const RaySettings &raySettings);
+};
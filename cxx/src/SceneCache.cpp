@@ -0,0 +1,204 @@
+#include "SceneCache.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char SCENE_CACHE_MAGIC[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', '\0'};
+
+struct SceneCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t layout;
+    uint64_t content_hash;
+};
+
+static uint64_t fnv1a(const char *data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char) data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// changes whenever the stored structures or the settings they were built with change
+static uint32_t layoutFingerprint() {
+    const int layout[] {
+            TRIANGLE_PACKET_SIZE, (int) sizeof(TrianglePacket), (int) sizeof(BvhNode), (int) sizeof(Vertex),
+            USE_BVH, BVH_MAX_LEAF_SIZE, BVH_SAH_BINS, BVH_MAX_DEPTH
+    };
+    return (uint32_t) fnv1a((const char *) layout, sizeof(layout));
+}
+
+// read only mapping of a whole file, unmapped when it goes out of scope
+struct MappedFile {
+    const char *data = nullptr;
+    size_t size = 0;
+
+    explicit MappedFile(const std::string &path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+
+        struct stat info {};
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                data = (const char *) mapping;
+                size = info.st_size;
+            }
+        }
+        close(fd);
+    }
+
+    ~MappedFile() {
+        if (data != nullptr) {
+            munmap((void *) data, size);
+        }
+    }
+};
+
+struct CacheReader {
+    const char *data;
+    size_t size;
+    size_t offset = 0;
+
+    template<typename T>
+    bool read(T &value) {
+        if (offset + sizeof(T) > size) {
+            return false;
+        }
+        std::memcpy(&value, data + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+
+    template<typename T>
+    bool readVector(std::vector<T> &values) {
+        uint64_t count;
+        if (!read(count) || offset + count * sizeof(T) > size) {
+            return false;
+        }
+        values.resize(count);
+        std::memcpy(values.data(), data + offset, count * sizeof(T));
+        offset += count * sizeof(T);
+        return true;
+    }
+};
+
+template<typename T>
+static void write(std::ofstream &out, const T &value) {
+    out.write((const char *) &value, sizeof(T));
+}
+
+template<typename T>
+static void writeVector(std::ofstream &out, const std::vector<T> &values) {
+    write(out, (uint64_t) values.size());
+    out.write((const char *) values.data(), values.size() * sizeof(T));
+}
+
+SceneCache::SceneCache(const std::string &objFile) {
+    cacheFile = objFile + ".scenecache";
+
+    MappedFile obj {objFile};
+    if (obj.data == nullptr) {
+        return;
+    }
+    contentHash = fnv1a(obj.data, obj.size);
+
+    MappedFile cache {cacheFile};
+    if (cache.data == nullptr) {
+        return;
+    }
+
+    loaded = read(cache.data, cache.size);
+    if (loaded) {
+        std::cout << "Scene loaded from cache " << cacheFile << std::endl;
+    } else {
+        std::cout << "Scene cache " << cacheFile << " is outdated" << std::endl;
+        cachedMeshes.clear();
+    }
+}
+
+bool SceneCache::read(const char *data, size_t size) {
+    CacheReader reader {data, size};
+
+    SceneCacheHeader header {};
+    if (!reader.read(header)) {
+        return false;
+    }
+
+    if (std::memcmp(header.magic, SCENE_CACHE_MAGIC, sizeof(SCENE_CACHE_MAGIC)) != 0 || header.version != SCENE_CACHE_VERSION
+        || header.layout != layoutFingerprint() || header.content_hash != contentHash) {
+        return false;
+    }
+
+    uint64_t mesh_count;
+    if (!reader.read(mesh_count)) {
+        return false;
+    }
+
+    cachedMeshes.resize(mesh_count);
+    for (Mesh &mesh : cachedMeshes) {
+        if (!reader.readVector(mesh.vertices) || !reader.readVector(mesh.triangles) || !reader.read(mesh.material)) {
+            return false;
+        }
+    }
+
+    return reader.readVector(cachedBvh.nodes)
+           && reader.readVector(cachedTriangles.packets)
+           && reader.readVector(cachedTriangles.materials)
+           && reader.offset == size;
+}
+
+bool SceneCache::restore(RaySettings &ray_settings) {
+    if (!loaded) {
+        return false;
+    }
+
+    ray_settings.bvh = std::move(cachedBvh);
+    ray_settings.triangles = std::move(cachedTriangles);
+    std::cout << "Restored " << ray_settings.bvh << " from cache" << std::endl;
+    return true;
+}
+
+void SceneCache::save(const RaySettings &ray_settings) const {
+    if (contentHash == 0) {
+        return;
+    }
+
+    // many runs may start on the same model at once, only a complete file is renamed into place
+    std::string temporaryFile = cacheFile + ".tmp" + std::to_string(getpid());
+    std::ofstream out(temporaryFile, std::ios::binary);
+
+    SceneCacheHeader header {};
+    std::memcpy(header.magic, SCENE_CACHE_MAGIC, sizeof(SCENE_CACHE_MAGIC));
+    header.version = SCENE_CACHE_VERSION;
+    header.layout = layoutFingerprint();
+    header.content_hash = contentHash;
+    write(out, header);
+
+    write(out, (uint64_t) ray_settings.meshes.size());
+    for (const Mesh &mesh : ray_settings.meshes) {
+        writeVector(out, mesh.vertices);
+        writeVector(out, mesh.triangles);
+        write(out, mesh.material);
+    }
+
+    writeVector(out, ray_settings.bvh.nodes);
+    writeVector(out, ray_settings.triangles.packets);
+    writeVector(out, ray_settings.triangles.materials);
+    out.close();
+
+    if (!out || std::rename(temporaryFile.c_str(), cacheFile.c_str()) != 0) {
+        std::cerr << "Could not write scene cache " << cacheFile << std::endl;
+        std::remove(temporaryFile.c_str());
+        return;
+    }
+
+    std::cout << "Scene cache written to " << cacheFile << std::endl;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <rays/Ray.h>
+
+
+// Binary cache of a preprocessed scene (meshes, bvh and triangle store), stored next to the obj file.
+// It is keyed on a hash of the obj content and on the packet/bvh layout, so a stale cache is never used.
+// The file is mapped and copied into the vectors of the meshes, bvh and triangle store in one pass each,
+// the mapping itself is released once the constructor returns.
+class SceneCache {
+public:
+    explicit SceneCache(const std::string &objFile);
+
+    // true when a cache matching the current obj content has been read
+    bool valid() const {
+        return loaded;
+    }
+
+    std::vector<Mesh> &meshes() {
+        return cachedMeshes;
+    }
+
+    // moves the cached acceleration structure into ray_settings, false when there is no valid cache
+    bool restore(RaySettings &ray_settings);
+
+    void save(const RaySettings &ray_settings) const;
+
+private:
+    std::string cacheFile;
+    uint64_t contentHash = 0;
+    bool loaded = false;
+
+    std::vector<Mesh> cachedMeshes;
+    Bvh cachedBvh;
+    TriangleStore cachedTriangles;
+
+    bool read(const char *data, size_t size);
+};
@@ -0,0 +1,266 @@
+#include "StreamingTracer.h"
+#include "config.h"
+#include <rays/RayTracing.h>
+#include "ThreadPool.h"
+#include <chrono>
+
+
+static_assert(STREAMING_BATCH_RAYS % RAY_CHUNK_SIZE == 0, "every chunk but the last has RAY_CHUNK_SIZE rays");
+
+
+// Traces the path of ray from startPoint and hands every segment to onSegment, including the last one that missed or
+// reached max_hit_level.
+template <typename OnSegment>
+static void walkPath(glm::vec3 startPoint, StartingDirection &direction, int ray_index, int seed, RaySettings &ray_settings,
+                     OnSegment &&onSegment) {
+    Ray ray = createFirstRay(startPoint, direction, ray_index, seed);
+    detectHit(ray, ray_settings);
+
+    for (int hit_level = 1; ; hit_level++) {
+        onSegment(ray);
+
+        if (!ray.hit || hit_level >= ray_settings.max_hit_level) {
+            return;
+        }
+
+        std::optional<Ray> reflectedRay = traceReflection(ray, hit_level, ray_settings);
+
+        if (!reflectedRay.has_value()) {
+            return;
+        }
+
+        ray = reflectedRay.value();
+    }
+}
+
+
+void streamIteration(int s, int e, int first_ray, glm::vec3 startPoint, std::vector<StartingDirection> &directions,
+                     RaySettings &ray_settings, Receiver *specularReceiver, Receiver *diffuseReceiver, std::vector<InitNums> &receivedCoords,
+                     HistogramAccumulator &specularAccumulator, HistogramAccumulator &diffuseAccumulator, int seed) {
+    Sphere receiverSphere {global_config->RECEIVER_LOCATION, global_config->RECEIVER_RADIUS};
+
+    for (int ray_i = s; ray_i < e; ray_i++) {
+        walkPath(startPoint, directions.at(ray_i), first_ray + ray_i, seed, ray_settings, [&](const Ray &ray) {
+            if (intersectWithSphere(receiverSphere, ray).has_value()) {
+                receivedCoords.push_back(ray.initNums);
+
+                if (specularReceiver != nullptr) {
+                    specularReceiver->receiveSpecular(ray, specularAccumulator);
+                }
+            }
+
+            if (diffuseReceiver != nullptr) {
+                diffuseReceiver->receiveDiffuse(ray, ray_settings, diffuseAccumulator);
+            }
+        });
+    }
+}
+
+StreamingResult streamRays(glm::vec3 startPoint, int amount_of_rays, const DirectionSource &directionSource, int seed, RaySettings &ray_settings,
+                           Receiver *specularReceiver, Receiver *diffuseReceiver, std::vector<InitNums> &receivedCoords,
+                           const ConvergenceTarget &target) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<StartingDirection> directions;
+    HistogramAccumulator specularTotal;
+    HistogramAccumulator diffuseTotal;
+    BandStatistics bandStatistics;
+    int rays = 0;
+
+    for (int first_ray = 0; first_ray < amount_of_rays; first_ray += STREAMING_BATCH_RAYS) {
+        int batch = std::min(STREAMING_BATCH_RAYS, amount_of_rays - first_ray);
+        int chunks = (batch + RAY_CHUNK_SIZE - 1) / RAY_CHUNK_SIZE;
+        directionSource(directions, first_ray, batch);
+
+        std::cout << "\rStreaming rays: " << first_ray << "/" << amount_of_rays << std::flush;
+
+        std::vector<std::vector<InitNums>> chunkCoords(chunks);
+        std::vector<std::array<double, N_BANDS>> chunkTotals(chunks);
+        HistogramReduction specularReduction {chunks};
+        HistogramReduction diffuseReduction {chunks};
+
+        threadPool().parallelFor(0, batch, RAY_CHUNK_SIZE, [&](int worker, int s, int e) {
+            int chunk = s / RAY_CHUNK_SIZE;
+            HistogramAccumulator specularAccumulator;
+            HistogramAccumulator diffuseAccumulator;
+
+            streamIteration(s, e, first_ray, startPoint, directions, ray_settings, specularReceiver, diffuseReceiver,
+                            chunkCoords.at(chunk), specularAccumulator, diffuseAccumulator, seed);
+
+            for (int band = 0; band < N_BANDS; band++) {
+                chunkTotals.at(chunk)[band] = specularAccumulator.band_totals[band] + diffuseAccumulator.band_totals[band];
+            }
+
+            specularReduction.add(chunk, std::move(specularAccumulator));
+            diffuseReduction.add(chunk, std::move(diffuseAccumulator));
+        });
+
+        // batches are added in order, the result does not depend on the batch size once the chunks are fixed
+        specularTotal.add(std::move(specularReduction.result()));
+        diffuseTotal.add(std::move(diffuseReduction.result()));
+
+        for (int chunk = 0; chunk < chunks; chunk++) {
+            bandStatistics.add(chunkTotals.at(chunk));
+            receivedCoords.insert(receivedCoords.end(), chunkCoords.at(chunk).begin(), chunkCoords.at(chunk).end());
+        }
+
+        rays = first_ray + batch;
+        double relative_error = bandStatistics.relativeError();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (target.relative_error > 0 && relative_error <= target.relative_error) {
+            std::cout << "\rConverged to relative error " << relative_error << " after " << rays << " rays" << std::endl;
+            break;
+        }
+
+        if (target.seconds > 0 && seconds >= target.seconds) {
+            std::cout << "\rTime budget used up at relative error " << relative_error << " after " << rays << " rays" << std::endl;
+            break;
+        }
+    }
+
+    std::cout << "\rStreaming rays: " << rays << "/" << amount_of_rays << std::endl;
+
+    if (specularReceiver != nullptr) {
+        specularReceiver->addAccumulator(specularTotal);
+    }
+
+    if (diffuseReceiver != nullptr) {
+        diffuseReceiver->addAccumulator(diffuseTotal);
+    }
+
+    return {rays, bandStatistics.relativeError()};
+}
+
+static Ray weightedRay(const Ray &ray, double weight) {
+    Ray weighted = ray;
+    weighted.current_energy.multiply((float) weight);
+    return weighted;
+}
+
+// A reciprocal path counts as much as the same path traced forward once it is scaled by the density of the direction
+// leaving the source over that of the direction leaving the receiver.
+// Diffuse energy scatters at the reflection next to the candidate, where a forward run scatters at the one next to the
+// receiver. Beyond the first reflection these are other paths, so initConfig only allows it with max_hit_level 1.
+void reciprocalIteration(int s, int e, int first_ray, glm::vec3 receiverPoint, std::vector<StartingDirection> &directions,
+                         RaySettings &ray_settings, const SphereGrid &candidates,
+                         std::vector<HistogramAccumulator> &specular, std::vector<HistogramAccumulator> &diffuse, int seed) {
+    std::vector<int> hits;
+
+    for (int ray_i = s; ray_i < e; ray_i++) {
+        double receiver_density = getDirectionDensity(directions.at(ray_i).d);
+
+        walkPath(receiverPoint, directions.at(ray_i), first_ray + ray_i, seed, ray_settings, [&](const Ray &ray) {
+            if (!specular.empty()) {
+                candidates.findHits(ray, hits);
+
+                // traced forward, the path leaves the candidate against this segment
+                for (int candidate : hits) {
+                    double weight = getDirectionDensity(-ray.direction) / receiver_density;
+                    Receiver::receiveSpecular(candidates.sphere(candidate), weightedRay(ray, weight), specular.at(candidate));
+                }
+            }
+
+            // next event estimation towards every candidate, a shadow ray each
+            float unfolded_t = ray.total_previous_t + ray.t;
+            float receiver_cone = ray.hit ? Receiver::coneFactor(candidates.radius, unfolded_t) : 0;
+
+            for (int candidate = 0; candidate < diffuse.size() && receiver_cone > 0; candidate++) {
+                glm::vec3 toHit = ray.hitInfo.hitPoint - candidates.centers.at(candidate);
+                float candidate_t = glm::length(toHit);
+                float candidate_cone = Receiver::coneFactor(candidates.radius, candidate_t);
+
+                if (candidate_cone <= 0) {
+                    continue;
+                }
+
+                double weight = getDirectionDensity(toHit / candidate_t) / receiver_density *
+                                (unfolded_t * unfolded_t) / (candidate_t * candidate_t) * receiver_cone / candidate_cone;
+                Receiver::receiveDiffuse(candidates.sphere(candidate), weightedRay(ray, weight), ray_settings, diffuse.at(candidate));
+            }
+        });
+    }
+}
+
+void streamReciprocal(glm::vec3 receiverPoint, int amount_of_rays, const DirectionSource &directionSource, int seed, RaySettings &ray_settings,
+                      const SphereGrid &candidates, std::vector<HistogramAccumulator> &specular, std::vector<HistogramAccumulator> &diffuse) {
+    std::vector<StartingDirection> directions;
+
+    for (int first_ray = 0; first_ray < amount_of_rays; first_ray += STREAMING_BATCH_RAYS) {
+        int batch = std::min(STREAMING_BATCH_RAYS, amount_of_rays - first_ray);
+        int chunks = (batch + RAY_CHUNK_SIZE - 1) / RAY_CHUNK_SIZE;
+        directionSource(directions, first_ray, batch);
+
+        std::cout << "\rReciprocal rays: " << first_ray << "/" << amount_of_rays << std::flush;
+
+        std::vector<std::vector<HistogramAccumulator>> chunkSpecular(chunks);
+        std::vector<std::vector<HistogramAccumulator>> chunkDiffuse(chunks);
+
+        threadPool().parallelFor(0, batch, RAY_CHUNK_SIZE, [&](int worker, int s, int e) {
+            int chunk = s / RAY_CHUNK_SIZE;
+            chunkSpecular.at(chunk).resize(specular.size());
+            chunkDiffuse.at(chunk).resize(diffuse.size());
+
+            reciprocalIteration(s, e, first_ray, receiverPoint, directions, ray_settings, candidates,
+                                chunkSpecular.at(chunk), chunkDiffuse.at(chunk), seed);
+        });
+
+        // in chunk order, the sums do not depend on the scheduling
+        for (int chunk = 0; chunk < chunks; chunk++) {
+            for (int candidate = 0; candidate < specular.size(); candidate++) {
+                specular.at(candidate).add(std::move(chunkSpecular.at(chunk).at(candidate)));
+            }
+
+            for (int candidate = 0; candidate < diffuse.size(); candidate++) {
+                diffuse.at(candidate).add(std::move(chunkDiffuse.at(chunk).at(candidate)));
+            }
+        }
+    }
+
+    std::cout << "\rReciprocal rays: " << amount_of_rays << "/" << amount_of_rays << std::endl;
+}
+
+void audienceIteration(int s, int e, int first_ray, glm::vec3 startPoint, std::vector<StartingDirection> &directions,
+                       RaySettings &ray_settings, const ReceiverSet &seats, std::vector<Ray> &segments,
+                       std::vector<std::pair<int, int>> &hits, int seed) {
+    std::vector<int> seatHits;
+
+    for (int ray_i = s; ray_i < e; ray_i++) {
+        walkPath(startPoint, directions.at(ray_i), first_ray + ray_i, seed, ray_settings, [&](const Ray &ray) {
+            if (!seats.specular.empty()) {
+                seats.seats.findHits(ray, seatHits);
+
+                for (int seat : seatHits) {
+                    hits.emplace_back(seat, (int) segments.size());
+                }
+            }
+
+            segments.push_back(ray);
+        });
+    }
+}
+
+void streamAudience(glm::vec3 startPoint, int amount_of_rays, const DirectionSource &directionSource, int seed, RaySettings &ray_settings,
+                    ReceiverSet &seats) {
+    std::vector<StartingDirection> directions;
+
+    for (int first_ray = 0; first_ray < amount_of_rays; first_ray += AUDIENCE_BATCH_RAYS) {
+        int batch = std::min(AUDIENCE_BATCH_RAYS, amount_of_rays - first_ray);
+        int chunks = (batch + AUDIENCE_CHUNK_RAYS - 1) / AUDIENCE_CHUNK_RAYS;
+        directionSource(directions, first_ray, batch);
+
+        std::cout << "\rAudience rays: " << first_ray << "/" << amount_of_rays << std::flush;
+
+        std::vector<std::vector<Ray>> chunkSegments(chunks);
+        std::vector<std::vector<std::pair<int, int>>> chunkHits(chunks);
+
+        threadPool().parallelFor(0, batch, AUDIENCE_CHUNK_RAYS, [&](int worker, int s, int e) {
+            int chunk = s / AUDIENCE_CHUNK_RAYS;
+            audienceIteration(s, e, first_ray, startPoint, directions, ray_settings, seats,
+                              chunkSegments.at(chunk), chunkHits.at(chunk), seed);
+        });
+
+        seats.receive(chunkSegments, chunkHits, ray_settings);
+    }
+
+    std::cout << "\rAudience rays: " << amount_of_rays << "/" << amount_of_rays << std::endl;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+#include <rays/Ray.h>
+#include <rays/SphereGrid.h>
+#include "Receiver.h"
+#include "ReceiverSet.h"
+
+
+// Stops a streaming pass before amount_of_rays once the band totals have converged or the time is up.
+struct ConvergenceTarget {
+    // largest standard error of a band total relative to that total, 0 disables
+    double relative_error;
+    // wall clock budget of the pass, 0 disables
+    double seconds;
+};
+
+struct StreamingResult {
+    int rays;
+    double relative_error;
+};
+
+// Traces up to amount_of_rays paths from startPoint and hands every segment to the receivers as soon as it is traced.
+// Only the current segment of every thread and one batch of directions are kept, so memory does not grow with the ray count.
+// A nullptr receiver skips that energy, receivedCoords gets the initNums of every segment through the receiver sphere.
+// The chunks of every batch are the samples of the convergence estimate.
+StreamingResult streamRays(glm::vec3 startPoint, int amount_of_rays, const DirectionSource &directionSource, int seed, RaySettings &ray_settings,
+                           Receiver *specularReceiver, Receiver *diffuseReceiver, std::vector<InitNums> &receivedCoords,
+                           const ConvergenceTarget &target = {0, 0});
+
+// Reciprocal pass, the paths start at the receiver and every candidate sphere of candidates they cross scores as the
+// receiver of that candidate source. specular and diffuse get one accumulator per candidate, an empty vector skips that energy.
+void streamReciprocal(glm::vec3 receiverPoint, int amount_of_rays, const DirectionSource &directionSource, int seed, RaySettings &ray_settings,
+                      const SphereGrid &candidates, std::vector<HistogramAccumulator> &specular, std::vector<HistogramAccumulator> &diffuse);
+
+// Traces amount_of_rays paths from startPoint for every seat of seats at once. The segments of a batch of rays are kept
+// and then scored seat by seat, so the diffuse energy of a batch is gathered per seat and no seat needs a histogram per thread.
+void streamAudience(glm::vec3 startPoint, int amount_of_rays, const DirectionSource &directionSource, int seed, RaySettings &ray_settings,
+                    ReceiverSet &seats);
@@ -0,0 +1,107 @@
+#include "ThreadPool.h"
+#include "settings.h"
+#include <algorithm>
+
+
+ThreadPool::ThreadPool(int threads) : queues(std::max(threads, 1)) {
+    for (int i = 0; i < queues.size(); i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto &th : workers) {
+        th.join();
+    }
+}
+
+void ThreadPool::parallelFor(int begin, int end, int chunk_size, const RangeTask &body) {
+    if (begin >= end) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> submit_lock(submit_mutex);
+
+    int chunks = (end - begin + chunk_size - 1) / chunk_size;
+    int per_worker = (chunks + size() - 1) / size();
+
+    task = &body;
+    remaining = chunks;
+
+    // neighbouring chunks start on the same worker, stealing only kicks in when it falls behind
+    for (int chunk_i = 0; chunk_i < chunks; chunk_i++) {
+        int s = begin + chunk_i * chunk_size;
+        WorkQueue &queue = queues[chunk_i / per_worker];
+
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.chunks.push_front({s, std::min(s + chunk_size, end)});
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    generation++;
+    wake.notify_all();
+
+    done.wait(lock, [this] { return remaining == 0; });
+    task = nullptr;
+}
+
+bool ThreadPool::takeChunk(int worker, Chunk &chunk) {
+    {
+        WorkQueue &own = queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.chunks.empty()) {
+            chunk = own.chunks.back();
+            own.chunks.pop_back();
+            return true;
+        }
+    }
+
+    for (int i = 1; i < queues.size(); i++) {
+        WorkQueue &victim = queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.chunks.empty()) {
+            chunk = victim.chunks.front();
+            victim.chunks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::workerLoop(int worker) {
+    int seen_generation = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen_generation; });
+
+            if (stopping) {
+                return;
+            }
+            seen_generation = generation;
+        }
+
+        Chunk chunk {};
+        while (takeChunk(worker, chunk)) {
+            (*task)(worker, chunk.s, chunk.e);
+
+            if (--remaining == 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                done.notify_all();
+            }
+        }
+    }
+}
+
+ThreadPool &threadPool() {
+    static ThreadPool pool {NUM_THREADS > 0 ? NUM_THREADS : (int) std::thread::hardware_concurrency()};
+    return pool;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Persistent workers with one deque of chunks each. A worker takes chunks from the back of its own deque
+// and steals from the front of the others once it runs dry, so uneven path lengths even out over the pass.
+class ThreadPool {
+public:
+    // body(worker, s, e) handles the rays [s, e), worker is in [0, size()) and never runs two chunks at once
+    typedef std::function<void(int worker, int s, int e)> RangeTask;
+
+    explicit ThreadPool(int threads);
+    ~ThreadPool();
+
+    int size() const {
+        return (int) workers.size();
+    }
+
+    // splits [begin, end) in chunks of chunk_size and returns when all of them are done, not reentrant
+    void parallelFor(int begin, int end, int chunk_size, const RangeTask &body);
+
+private:
+    struct Chunk {
+        int s;
+        int e;
+    };
+
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Chunk> chunks;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<WorkQueue> queues;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::mutex submit_mutex;
+
+    const RangeTask *task = nullptr;
+    std::atomic<int> remaining {0};
+    int generation = 0;
+    bool stopping = false;
+
+    void workerLoop(int worker);
+    bool takeChunk(int worker, Chunk &chunk);
+};
+
+// pool shared by all passes, NUM_THREADS workers or one per hardware thread when NUM_THREADS is 0
+ThreadPool &threadPool();
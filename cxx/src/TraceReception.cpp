@@ -0,0 +1,54 @@
+#include "TraceReception.h"
+#include "Receiver.h"
+#include "config.h"
+#include <rays/RayTracing.h>
+
+
+void TraceReception::clear() {
+    valid = false;
+    specular = HistogramAccumulator {};
+    diffuse = HistogramAccumulator {};
+    hitCoords.clear();
+}
+
+void TraceReception::beginLevel(int chunks) {
+    levelSpecular = std::make_unique<HistogramReduction>(chunks);
+    levelDiffuse = std::make_unique<HistogramReduction>(chunks);
+    levelHitCoords.assign(chunks, {});
+}
+
+void TraceReception::add(int chunk, ReceptionChunk &&reception) {
+    levelSpecular->add(chunk, std::move(reception.specular));
+    levelDiffuse->add(chunk, std::move(reception.diffuse));
+    levelHitCoords[chunk] = std::move(reception.hitCoords);
+}
+
+void TraceReception::endLevel() {
+    specular.add(std::move(levelSpecular->result()));
+    diffuse.add(std::move(levelDiffuse->result()));
+
+    for (std::vector<InitNums> &coords : levelHitCoords) {
+        hitCoords.insert(hitCoords.end(), coords.begin(), coords.end());
+    }
+
+    levelSpecular.reset();
+    levelDiffuse.reset();
+    levelHitCoords.clear();
+}
+
+void TraceReception::receive(Ray &ray, const RaySettings &raySettings, ReceptionChunk &chunk) const {
+    Sphere receiverSphere {global_config->RECEIVER_LOCATION, global_config->RECEIVER_RADIUS};
+
+    if (intersectWithSphere(receiverSphere, ray).has_value()) {
+        ray.received = true;
+        chunk.hitCoords.push_back(ray.initNums);
+
+        if (energy && global_config->SPECULAR_ENERGY) {
+            Receiver::receiveSpecular(receiverSphere, ray, chunk.specular);
+        }
+    }
+
+    if (energy && global_config->DIFFUSE_ENERGY) {
+        Receiver::receiveDiffuse(receiverSphere, ray, raySettings, chunk.diffuse);
+    }
+}
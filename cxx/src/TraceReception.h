@@ -0,0 +1,43 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <rays/Ray.h>
+#include "HistogramAccumulator.h"
+
+
+// What the receiver gets from the segments of one work item of a traced level.
+struct ReceptionChunk {
+    HistogramAccumulator specular;
+    HistogramAccumulator diffuse;
+    std::vector<InitNums> hitCoords;
+};
+
+// Receiver energy and importance sampling hits gathered while the stored pipeline traces, so the diffuse pass, the
+// specular pass and Gmm::findHitProjectionCoords do not have to sweep all_rays again afterwards.
+struct TraceReception {
+    // set before a pass whose histogram is saved next, the importance sampling steps only need the hit coords
+    bool energy = false;
+    // set once a pass has filled it, cleared again when the next pass starts
+    bool valid = false;
+    HistogramAccumulator specular;
+    HistogramAccumulator diffuse;
+    std::vector<InitNums> hitCoords;
+
+    void clear();
+
+    // a level traced in chunks work items, every chunk in [0, chunks) is added exactly once before endLevel
+    void beginLevel(int chunks);
+    // thread safe
+    void add(int chunk, ReceptionChunk &&reception);
+    // adds the sums of the level, the hit coords in chunk order
+    void endLevel();
+
+    // receiver sphere test, hit coords and with energy the diffuse shadow ray of a segment right after it is traced,
+    // marks the segment received when it passes through the receiver
+    void receive(Ray &ray, const RaySettings &raySettings, ReceptionChunk &chunk) const;
+
+private:
+    std::unique_ptr<HistogramReduction> levelSpecular;
+    std::unique_ptr<HistogramReduction> levelDiffuse;
+    std::vector<std::vector<InitNums>> levelHitCoords;
+};
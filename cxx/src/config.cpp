@@ -17,6 +17,16 @@ glm::vec3 jsonToVec(json::value_type json) {
     return {json["x"], json["y"], json["z"]};
 }
 
+std::vector<glm::vec3> jsonToVecs(json::value_type json) {
+    std::vector<glm::vec3> vecs;
+
+    for (auto &vec : json) {
+        vecs.push_back(jsonToVec(vec));
+    }
+
+    return vecs;
+}
+
 Energy jsonToEnergy(json::value_type json) {
     return {
             BOOST_PP_ENUM(N_BANDS, TEXT, json)
@@ -35,7 +45,7 @@ Config initConfig(boost::filesystem::path path) {
     json configFile = json::parse(f);
 
 
-    return {
+    Config config {
             configFile["seed"],
             configFile["filename"],
             configFile["source"]["use_source_plane"],
@@ -56,8 +66,36 @@ Config initConfig(boost::filesystem::path path) {
             configFile["auto_importance_sampling_steps"],
             configFile["output_location"],
             configFile.get<PROJECTION_METHODS>(),
-                    configFile["volume"]
+                    configFile["volume"],
+            configFile.value("streaming", false),
+            configFile.value("proposal", GMM_PROPOSAL),
+            configFile.value("defensive_fraction", 0.0f),
+            configFile.value("target_relative_error", 0.0f),
+            configFile.value("max_trace_seconds", 0.0f),
+            configFile.value("sampling", RANDOM_SAMPLING),
+            configFile.value("energy_floor", 0.0f),
+            configFile.value("roulette_threshold", 0.0f),
+            configFile.value("image_source_order", -1),
+            configFile.value("reciprocal", false),
+            jsonToVecs(configFile.value("audience_seats", json::array())),
+            jsonToVecs(configFile.value("audience_polygon", json::array())),
+            configFile.value("audience_spacing", 1.0f),
+            configFile.value("audience_ear_height", 1.2f)
     };
+
+    // above 1 the mixture weight of the proposal turns negative, below 0 the probability clamp is silently back on
+    if (config.DEFENSIVE_FRACTION < 0 || config.DEFENSIVE_FRACTION > 1) {
+        std::cerr << "defensive_fraction is " << config.DEFENSIVE_FRACTION << ", it is a share of the rays and must lie in [0, 1]" << std::endl;
+        throw std::exception();
+    }
+
+    if (config.STREAMING && config.USE_SOURCE_PLANE && config.RECIPROCAL && config.DIFFUSE_ENERGY && config.MAX_HIT_LEVEL > 1) {
+        std::cerr << "Reciprocal diffuse energy scatters next to the candidate, beyond the first reflection it scores other paths "
+                     "than a forward run. Use max_hit_level 1 or turn diffuse_energy off" << std::endl;
+        throw std::exception();
+    }
+
+    return config;
 }
 
 
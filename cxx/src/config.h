@@ -2,6 +2,7 @@
 
 #include <boost/filesystem/path.hpp>
 #include <glm/vec3.hpp>
+#include <vector>
 #include <rays/Energy.h>
 #include "settings.h"
 
@@ -41,6 +42,38 @@ struct Config {
     const int PROJECTION_METHOD = EQUI_RECT;
 
     const float VOLUME = 0.0;
+
+    // trace headless without keeping all_rays, energy goes into the histogram while tracing
+    const bool STREAMING = false;
+
+    const int PROPOSAL_METHOD = GMM_PROPOSAL;
+    // fraction of the importance sampled rays drawn uniformly, bounds 1 / probability by 1 / DEFENSIVE_FRACTION
+    const float DEFENSIVE_FRACTION = 0.0f;
+
+    // streaming mode, stop the final pass early once every band total has this relative standard error, 0 traces all rays
+    const float TARGET_RELATIVE_ERROR = 0.0f;
+    // streaming mode, wall clock budget of the final pass in seconds, 0 is unlimited
+    const float MAX_TRACE_SECONDS = 0.0f;
+
+    const int SAMPLING_METHOD = RANDOM_SAMPLING;
+
+    // reflections whose average band energy is below ENERGY_FLOOR end the path, 0 keeps every reflection
+    const float ENERGY_FLOOR = 0.0f;
+    // below this average band energy a reflection survives with probability energy / ROULETTE_THRESHOLD, 0 disables roulette
+    const float ROULETTE_THRESHOLD = 0.0f;
+
+    // specular reflections up to this order come from the image sources instead of the rays, -1 disables them
+    const int IMAGE_SOURCE_ORDER = -1;
+
+    // streaming with a source plane, trace once from the receiver and score every candidate source sphere
+    const bool RECIPROCAL = false;
+
+    // streaming without a source plane, a histogram per seat from one trace of the sender. The seats are AUDIENCE_SEATS
+    // and a grid over AUDIENCE_POLYGON, AUDIENCE_SPACING apart and AUDIENCE_EAR_HEIGHT above it
+    const std::vector<glm::vec3> AUDIENCE_SEATS;
+    const std::vector<glm::vec3> AUDIENCE_POLYGON;
+    const float AUDIENCE_SPACING = 1.0f;
+    const float AUDIENCE_EAR_HEIGHT = 1.2f;
 };
 
 
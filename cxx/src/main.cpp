@@ -21,11 +21,14 @@
 #include <vector>
 #include <rays/Gmm.h>
 #include <chrono>
+#include <fstream>
 
 #include "draw.h"
 #include "Receiver.h"
 #include "config.h"
 #include "auto_runner.h"
+#include "SceneCache.h"
+#include "StreamingTracer.h"
 
 constexpr glm::ivec2 windowResolution { 800, 800 };
 Config* global_config;
@@ -33,10 +36,7 @@ Config* global_config;
 
 void update_ray_iteration(std::vector<Ray> &all_rays, RaySettings &ray_settings, Receiver &receiver, int seed, Gmm &gmm);
 
-void inline saveFileOfHistogram(std::vector<Ray> &all_rays, RaySettings &ray_settings) {
-    Receiver receiver {global_config->RECEIVER_LOCATION, global_config->RECEIVER_RADIUS};
-
-
+HISTOGRAM_TYPE configuredHistogramType() {
     HISTOGRAM_TYPE histogramType;
 
     if (global_config->SPECULAR_ENERGY) {
@@ -51,11 +51,15 @@ void inline saveFileOfHistogram(std::vector<Ray> &all_rays, RaySettings &ray_set
         histogramType = BOTH;
     }
 
+    return histogramType;
+}
 
+void inline saveFileOfHistogram(std::vector<Ray> &all_rays, RaySettings &ray_settings, const TraceReception &traced) {
+    Receiver receiver {global_config->RECEIVER_LOCATION, global_config->RECEIVER_RADIUS};
 
-    auto output_path = getAndMakeOutputPath(histogramType);
+    auto output_path = getAndMakeOutputPath(configuredHistogramType());
 
-    receiver.listenToRays(all_rays, ray_settings);
+    receiver.listenToRays(all_rays, ray_settings, &traced);
     receiver.saveToFile(output_path / "histogram.csv");
     receiver.saveSettings(output_path / "histogram.json");
     std::cout << "Histogram has been written to file" << std::endl;
@@ -169,11 +173,12 @@ int autoRun(std::vector<Ray> &all_rays, RaySettings &ray_settings, Receiver &rec
 
     for (int i = 0; i < is_steps; i++) {
         seed++;
+        receiver.traced.energy = i == is_steps - 1;
         update_ray_iteration(all_rays, ray_settings, receiver, seed, gmm);
     }
 
     if (global_config->QUIT_AFTER_AUTO_RUN) {
-        saveFileOfHistogram(all_rays, ray_settings);
+        saveFileOfHistogram(all_rays, ray_settings, receiver.traced);
         return 0;
     }
 
@@ -182,6 +187,185 @@ int autoRun(std::vector<Ray> &all_rays, RaySettings &ray_settings, Receiver &rec
 
 }
 
+// the diffuse histogram on its own and the configured one, which includes the diffuse energy
+void saveStreamingHistograms(Receiver &receiver, Receiver &diffuseReceiver, const std::string &folder) {
+    if (global_config->DIFFUSE_ENERGY) {
+        auto output_path = getAndMakeOutputPath(DIFFUSE, folder);
+        diffuseReceiver.saveToFile(output_path / "histogram.csv");
+        diffuseReceiver.saveSettings(output_path / "histogram.json");
+        std::cout << "diffuse is saved at " << output_path << std::endl;
+
+        receiver.addHistogram(diffuseReceiver);
+    }
+
+    auto output_path = getAndMakeOutputPath(configuredHistogramType(), folder);
+    receiver.saveToFile(output_path / "histogram.csv");
+    receiver.saveSettings(output_path / "histogram.json");
+    std::cout << "Histogram has been written to file" << std::endl;
+}
+
+// which <name>_<i> folder belongs to which location, in <name>s.csv
+void saveLocationIndex(const std::vector<glm::vec3> &locations, const std::string &name) {
+    std::ofstream index((getAndMakeOutputPath(configuredHistogramType()) / (name + "s.csv")).c_str());
+    index << name << ",x,y,z" << '\n';
+
+    for (int i = 0; i < locations.size(); i++) {
+        index << i << ',' << locations[i].x << ',' << locations[i].y << ',' << locations[i].z << '\n';
+    }
+}
+
+// the image sources of source when they are configured, built before tracing so an order that is too high fails right away
+bool buildImageSources(ImageSourceTree &imageSources, RaySettings &ray_settings, glm::vec3 source) {
+    if (!global_config->SPECULAR_ENERGY || global_config->IMAGE_SOURCE_ORDER < 0) {
+        return false;
+    }
+
+    imageSources.build(ray_settings, source, global_config->IMAGE_SOURCE_ORDER);
+    return true;
+}
+
+// The histograms of every location in its <name>_<i> folder from the accumulators of a shared trace, an empty vector
+// skips that energy. One location at a time, only the accumulators of the others stay in memory.
+void saveLocationHistograms(const std::vector<glm::vec3> &locations, const std::string &name,
+                            std::vector<HistogramAccumulator> &specular, std::vector<HistogramAccumulator> &diffuse,
+                            const ImageSourceTree *imageSources, RaySettings &ray_settings, bool reciprocal) {
+    for (int location = 0; location < locations.size(); location++) {
+        Receiver receiver {locations[location], global_config->RECEIVER_RADIUS};
+        Receiver diffuseReceiver {locations[location], global_config->RECEIVER_RADIUS};
+
+        if (!specular.empty()) {
+            receiver.addAccumulator(specular.at(location));
+            specular.at(location) = {};
+        }
+
+        if (imageSources != nullptr) {
+            receiver.receiveImageSources(*imageSources, ray_settings, ray_settings.amount_of_rays, reciprocal);
+        }
+
+        if (!diffuse.empty()) {
+            diffuseReceiver.addAccumulator(diffuse.at(location));
+            diffuse.at(location) = {};
+        }
+
+        saveStreamingHistograms(receiver, diffuseReceiver, name + "_" + std::to_string(location));
+    }
+}
+
+// the histograms of sender, below the folder of source unless it is -1
+int streamingRun(RaySettings &ray_settings, glm::vec3 sender, int source) {
+    Gmm gmm {};
+    int seed = global_config->SEED;
+    std::cout << "Streaming run seed: " << seed << std::endl;
+    int is_steps = global_config->IMPORTANCE_SAMPLING ? global_config->AUTO_IMPORTANCE_SAMPLING_STEPS : 0;
+
+    ImageSourceTree imageSources;
+    bool use_image_sources = buildImageSources(imageSources, ray_settings, sender);
+
+    // the importance sampling steps only collect where the receiver was hit
+    std::vector<InitNums> receivedCoords;
+    for (int i = 0; i < is_steps; i++) {
+        std::vector<InitNums> hitCoords = std::move(receivedCoords);
+        receivedCoords.clear();
+
+        DirectionSource directionSource = gmm.directionSource(hitCoords, seed);
+        streamRays(sender, ray_settings.amount_of_rays, directionSource, seed, ray_settings, nullptr, nullptr, receivedCoords);
+        seed++;
+    }
+
+    DirectionSource directionSource = global_config->IMPORTANCE_SAMPLING ?
+            gmm.directionSource(receivedCoords, seed) : uniformDirectionSource(seed);
+    receivedCoords.clear();
+
+    Receiver receiver {global_config->RECEIVER_LOCATION, global_config->RECEIVER_RADIUS};
+    Receiver diffuseReceiver {global_config->RECEIVER_LOCATION, global_config->RECEIVER_RADIUS};
+
+    // amount_of_rays is the upper bound of a progressive pass
+    ConvergenceTarget target {global_config->TARGET_RELATIVE_ERROR, global_config->MAX_TRACE_SECONDS};
+    StreamingResult result = streamRays(sender, ray_settings.amount_of_rays, directionSource, seed, ray_settings,
+                                        global_config->SPECULAR_ENERGY ? &receiver : nullptr,
+                                        global_config->DIFFUSE_ENERGY ? &diffuseReceiver : nullptr,
+                                        receivedCoords, target);
+
+    for (Receiver *r : {&receiver, &diffuseReceiver}) {
+        r->rays_traced = result.rays;
+        r->relative_error = result.relative_error;
+    }
+
+    if (use_image_sources) {
+        receiver.receiveImageSources(imageSources, ray_settings, result.rays);
+    }
+
+    saveStreamingHistograms(receiver, diffuseReceiver, source < 0 ? "" : "source_" + std::to_string(source));
+    return 0;
+}
+
+// Every candidate of the source plane in one process, sharing the scene and its acceleration structure.
+// The candidates run one after another on the whole pool and use the same seed, so their rays are directly comparable.
+int streamingSourcesRun(RaySettings &ray_settings) {
+    std::vector<glm::vec3> &sources = ray_settings.sourceLocations;
+    saveLocationIndex(sources, "source");
+
+    for (int source = 0; source < sources.size(); source++) {
+        std::cout << "Source " << source + 1 << "/" << sources.size() << std::endl;
+        streamingRun(ray_settings, sources[source], source);
+    }
+
+    return 0;
+}
+
+// All candidates of the source plane from a single trace. By reciprocity a path from the receiver through a candidate
+// sphere carries the energy of the path from that candidate to a receiver sphere, so every candidate scores on the same rays.
+// There is no single target to importance sample towards, the directions are always drawn uniformly.
+int reciprocalRun(RaySettings &ray_settings) {
+    std::vector<glm::vec3> &sources = ray_settings.sourceLocations;
+    saveLocationIndex(sources, "source");
+
+    SphereGrid candidates;
+    candidates.build(sources, global_config->RECEIVER_RADIUS);
+    std::cout << "Reciprocal run over " << sources.size() << " candidate sources" << std::endl;
+
+    std::vector<HistogramAccumulator> specular(global_config->SPECULAR_ENERGY ? sources.size() : 0);
+    std::vector<HistogramAccumulator> diffuse(global_config->DIFFUSE_ENERGY ? sources.size() : 0);
+
+    // the image sources of the receiver reach every candidate
+    ImageSourceTree imageSources;
+    bool use_image_sources = buildImageSources(imageSources, ray_settings, global_config->RECEIVER_LOCATION);
+
+    int seed = global_config->SEED;
+    streamReciprocal(global_config->RECEIVER_LOCATION, ray_settings.amount_of_rays, uniformDirectionSource(seed), seed, ray_settings,
+                     candidates, specular, diffuse);
+
+    saveLocationHistograms(sources, "source", specular, diffuse, use_image_sources ? &imageSources : nullptr, ray_settings, true);
+
+    return 0;
+}
+
+// Every seat of the audience from one trace of the sender, the seats share all rays.
+// Importance sampling has no single receiver to aim at, so the directions are drawn uniformly.
+int audienceRun(RaySettings &ray_settings) {
+    std::vector<glm::vec3> seats = global_config->AUDIENCE_SEATS;
+    std::vector<glm::vec3> polygonSeats = seatsInPolygon(global_config->AUDIENCE_POLYGON, global_config->AUDIENCE_SPACING,
+                                                         global_config->AUDIENCE_EAR_HEIGHT);
+    seats.insert(seats.end(), polygonSeats.begin(), polygonSeats.end());
+    saveLocationIndex(seats, "seat");
+
+    ReceiverSet receiverSet;
+    receiverSet.build(seats, global_config->RECEIVER_RADIUS, global_config->SPECULAR_ENERGY, global_config->DIFFUSE_ENERGY);
+    std::cout << "Audience run over " << seats.size() << " seats" << std::endl;
+
+    ImageSourceTree imageSources;
+    bool use_image_sources = buildImageSources(imageSources, ray_settings, global_config->SENDER_LOCATION);
+
+    int seed = global_config->SEED;
+    streamAudience(global_config->SENDER_LOCATION, ray_settings.amount_of_rays, uniformDirectionSource(seed), seed, ray_settings,
+                   receiverSet);
+
+    saveLocationHistograms(seats, "seat", receiverSet.specular, receiverSet.diffuse, use_image_sources ? &imageSources : nullptr,
+                           ray_settings, false);
+
+    return 0;
+}
+
 int main(int argc, char** argv) {
 
     start_time = std::chrono::steady_clock::now();
@@ -195,7 +379,13 @@ int main(int argc, char** argv) {
     global_config = &config;
 
     std::string path = boost::filesystem::current_path().string() + global_config->filename.string();
-    std::vector<Mesh> meshes = loadMesh(path);
+
+    // skip assimp and the bvh build when this obj has been preprocessed before
+    std::optional<SceneCache> sceneCache;
+    if (USE_SCENE_CACHE) {
+        sceneCache.emplace(path);
+    }
+    std::vector<Mesh> meshes = sceneCache && sceneCache->valid() ? std::move(sceneCache->meshes()) : loadMesh(path);
 
     std::vector<Mesh> sourcePlanes;
 
@@ -212,27 +402,60 @@ int main(int argc, char** argv) {
     std::cout << "Model loaded" << std::endl;
 
 
-    Window window { argv[0], windowResolution, OpenGLVersion::GL2 };
-    Trackball camera { &window, glm::radians(50.0f), 3.0f };
+    RaySettings ray_settings{global_config->RAYS_CAST, global_config->MAX_HIT_LEVEL, meshes};
+    if (global_config->USE_SOURCE_PLANE) {
+        ray_settings.initialize_source_locations(sourcePlanes);
+    }
 
+    if (!sceneCache || !sceneCache->restore(ray_settings)) {
+        initialize_meshes(ray_settings);
 
-    int ray_array_size = global_config->MAX_HIT_LEVEL * global_config->RAYS_CAST;
-    std::vector<Ray> all_rays (ray_array_size);
+        if (sceneCache) {
+            sceneCache->save(ray_settings);
+        }
+    }
 
+    if (global_config->IMAGE_SOURCE_ORDER >= 0) {
+        initialize_walls(ray_settings);
+    }
 
-    RaySettings ray_settings{global_config->RAYS_CAST, global_config->MAX_HIT_LEVEL, meshes};
-    if (global_config->USE_SOURCE_PLANE) {
-        ray_settings.initialize_source_locations(sourcePlanes);
+
+
+
+    // headless, rays are never stored so there is nothing to draw
+    if (global_config->STREAMING && global_config->USE_SOURCE_PLANE && global_config->RECIPROCAL) {
+        return reciprocalRun(ray_settings);
     }
 
-    initialize_meshes(ray_settings);
+    if (global_config->STREAMING && global_config->USE_SOURCE_PLANE) {
+        return streamingSourcesRun(ray_settings);
+    }
 
+    bool audience = !global_config->AUDIENCE_SEATS.empty() || global_config->AUDIENCE_POLYGON.size() >= 3;
+    if (global_config->STREAMING && audience) {
+        return audienceRun(ray_settings);
+    }
 
+    if (global_config->STREAMING) {
+        return streamingRun(ray_settings, global_config->SENDER_LOCATION, -1);
+    }
+
+    Gmm gmm {};
+
+
+    Window window { argv[0], windowResolution, OpenGLVersion::GL2 };
+    Trackball camera { &window, glm::radians(50.0f), 3.0f };
+
+
+    int ray_array_size = global_config->MAX_HIT_LEVEL * global_config->RAYS_CAST;
+    std::vector<Ray> all_rays (ray_array_size);
 
 
     Receiver receiver {global_config->RECEIVER_LOCATION, global_config->RECEIVER_RADIUS};
-    Gmm gmm {};
 
+    // the histogram is saved right after the first pass when no importance sampling step follows it
+    int is_steps = global_config->IMPORTANCE_SAMPLING ? global_config->AUTO_IMPORTANCE_SAMPLING_STEPS : 0;
+    receiver.traced.energy = global_config->AUTO_RUN ? is_steps == 0 : AUTO_OUTPUT;
     update_ray_iteration(all_rays, ray_settings, receiver, global_config->SEED, gmm);
 
 
@@ -268,7 +491,7 @@ int main(int argc, char** argv) {
         if ((camera.keypress.pressed && camera.keypress.key == GLFW_KEY_F) || AUTO_OUTPUT) {
             camera.keypress.pressed = false;
 
-            saveFileOfHistogram(all_rays, ray_settings);
+            saveFileOfHistogram(all_rays, ray_settings, receiver.traced);
 
             if (AUTO_OUTPUT) {
                 return 0;
@@ -310,17 +533,19 @@ int main(int argc, char** argv) {
 
 void
 update_ray_iteration(std::vector<Ray> &all_rays, RaySettings &ray_settings, Receiver &receiver, int seed, Gmm &gmm) {
+    TraceReception *reception = FUSED_RECEPTION ? &receiver.traced : nullptr;
+
     if (!global_config->IMPORTANCE_SAMPLING) {
-        generateRays(all_rays, global_config->SENDER_LOCATION, ray_settings, seed);
+        generateRays(all_rays, global_config->SENDER_LOCATION, ray_settings, seed, reception);
         return;
     }
 
     std::cout << "Generating new rays with seed " << seed << std::endl;
-    gmm.generateRays(all_rays, global_config->SENDER_LOCATION, ray_settings, seed);
+    gmm.generateRays(all_rays, global_config->SENDER_LOCATION, ray_settings, seed, reception);
 
     // for drawing
     if (DRAW_ONLY_INTERSECTIONS) {
-        receiver.addSpecularEnergyToHistogram(all_rays);
+        receiver.addSpecularEnergyToHistogram(all_rays, ray_settings);
     }
 }
 
@@ -0,0 +1,211 @@
+#include "Bvh.h"
+#include <glm/geometric.hpp>
+#include <algorithm>
+#include <iostream>
+#include <stack>
+
+
+void Aabb::grow(const glm::vec3 &point) {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+}
+
+void Aabb::grow(const Aabb &aabb) {
+    min = glm::min(min, aabb.min);
+    max = glm::max(max, aabb.max);
+}
+
+glm::vec3 Aabb::center() const {
+    return (min + max) * 0.5f;
+}
+
+float Aabb::surfaceArea() const {
+    glm::vec3 extent = max - min;
+
+    // empty box
+    if (extent.x < 0 || extent.y < 0 || extent.z < 0) {
+        return 0.0f;
+    }
+
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+struct BuildPrimitive {
+    Aabb bounds;
+    glm::vec3 centroid;
+    int primitive;
+};
+
+struct SahBin {
+    Aabb bounds;
+    int count = 0;
+};
+
+struct BuildTask {
+    int node;
+    int start;
+    int end;
+    int depth;
+};
+
+static int packetCount(int triangles) {
+    return (triangles + TRIANGLE_PACKET_SIZE - 1) / TRIANGLE_PACKET_SIZE;
+}
+
+static int binIndex(const glm::vec3 &centroid, const Aabb &centroidBounds, int axis) {
+    float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+    int bin = (int) ((centroid[axis] - centroidBounds.min[axis]) / extent * BVH_SAH_BINS);
+    return std::min(std::max(bin, 0), BVH_SAH_BINS - 1);
+}
+
+void Bvh::build(const std::vector<SceneTriangle> &triangles) {
+    nodes.clear();
+    primitives.clear();
+
+    std::vector<BuildPrimitive> buildPrimitives;
+    buildPrimitives.reserve(triangles.size());
+    for (int triangle_i = 0; triangle_i < triangles.size(); triangle_i++) {
+        const SceneTriangle &triangle = triangles.at(triangle_i);
+
+        Aabb bounds;
+        bounds.grow(triangle.vertex_0);
+        bounds.grow(triangle.vertex_1);
+        bounds.grow(triangle.vertex_2);
+
+        buildPrimitives.push_back({bounds, bounds.center(), triangle_i});
+    }
+
+    if (buildPrimitives.empty()) {
+        return;
+    }
+
+    nodes.reserve(2 * buildPrimitives.size());
+    nodes.push_back({});
+
+    std::stack<BuildTask> tasks;
+    tasks.push({0, 0, (int) buildPrimitives.size(), 0});
+
+    while (!tasks.empty()) {
+        BuildTask task = tasks.top();
+        tasks.pop();
+
+        Aabb bounds;
+        Aabb centroidBounds;
+        for (int i = task.start; i < task.end; i++) {
+            bounds.grow(buildPrimitives[i].bounds);
+            centroidBounds.grow(buildPrimitives[i].centroid);
+        }
+
+        int count = task.end - task.start;
+        nodes.at(task.node).bounds = bounds;
+        nodes.at(task.node).first = task.start;
+        nodes.at(task.node).count = count;
+
+        if (count <= BVH_MAX_LEAF_SIZE || task.depth >= BVH_MAX_DEPTH) {
+            continue;
+        }
+
+        // binned surface area heuristic, a leaf costs one intersection per triangle packet
+        float best_cost = BVH_SAH_INTERSECTION_COST * packetCount(count);
+        int best_axis = -1;
+        int best_split = -1;
+        float parent_area = bounds.surfaceArea();
+
+        for (int axis = 0; axis < 3; axis++) {
+            if (centroidBounds.max[axis] - centroidBounds.min[axis] <= 0.0f) {
+                continue;
+            }
+
+            SahBin bins[BVH_SAH_BINS];
+            for (int i = task.start; i < task.end; i++) {
+                SahBin &bin = bins[binIndex(buildPrimitives[i].centroid, centroidBounds, axis)];
+                bin.bounds.grow(buildPrimitives[i].bounds);
+                bin.count++;
+            }
+
+            // sweep from the left, then from the right to evaluate every split plane
+            float left_area[BVH_SAH_BINS - 1];
+            int left_count[BVH_SAH_BINS - 1];
+            Aabb left_bounds;
+            int left_total = 0;
+            for (int bin = 0; bin < BVH_SAH_BINS - 1; bin++) {
+                left_bounds.grow(bins[bin].bounds);
+                left_total += bins[bin].count;
+                left_area[bin] = left_bounds.surfaceArea();
+                left_count[bin] = left_total;
+            }
+
+            Aabb right_bounds;
+            int right_total = 0;
+            for (int bin = BVH_SAH_BINS - 1; bin > 0; bin--) {
+                right_bounds.grow(bins[bin].bounds);
+                right_total += bins[bin].count;
+
+                if (left_count[bin - 1] == 0 || right_total == 0) {
+                    continue;
+                }
+
+                float cost = BVH_SAH_TRAVERSAL_COST + BVH_SAH_INTERSECTION_COST *
+                        (packetCount(left_count[bin - 1]) * left_area[bin - 1] + packetCount(right_total) * right_bounds.surfaceArea()) / parent_area;
+
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = bin - 1;
+                }
+            }
+        }
+
+        int mid;
+        if (best_axis != -1) {
+            auto split_begin = buildPrimitives.begin() + task.start;
+            auto split_end = buildPrimitives.begin() + task.end;
+            mid = (int) (std::partition(split_begin, split_end, [&](const BuildPrimitive &primitive) {
+                return binIndex(primitive.centroid, centroidBounds, best_axis) <= best_split;
+            }) - buildPrimitives.begin());
+        } else if (count > BVH_MAX_LEAF_SIZE * 4) {
+            // SAH prefers a leaf but it is too large, fall back to a median split over the widest axis
+            glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+            int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+            mid = task.start + count / 2;
+            std::nth_element(buildPrimitives.begin() + task.start, buildPrimitives.begin() + mid, buildPrimitives.begin() + task.end,
+                             [axis](const BuildPrimitive &a, const BuildPrimitive &b) {
+                                 return a.centroid[axis] < b.centroid[axis];
+                             });
+        } else {
+            continue;
+        }
+
+        if (mid == task.start || mid == task.end) {
+            continue;
+        }
+
+        int left = (int) nodes.size();
+        nodes.push_back({});
+        nodes.push_back({});
+        nodes.at(task.node).first = left;
+        nodes.at(task.node).count = 0;
+
+        tasks.push({left + 1, mid, task.end, task.depth + 1});
+        tasks.push({left, task.start, mid, task.depth + 1});
+    }
+
+    primitives.reserve(buildPrimitives.size());
+    for (const BuildPrimitive &buildPrimitive : buildPrimitives) {
+        primitives.push_back(buildPrimitive.primitive);
+    }
+}
+
+std::ostream &operator<<(std::ostream &out, const Bvh &bvh) {
+    int leafs = 0;
+    int triangles = 0;
+    for (const BvhNode &node : bvh.nodes) {
+        if (node.isLeaf()) {
+            leafs++;
+            triangles += node.count;
+        }
+    }
+
+    out << "(bvh nodes: " << bvh.nodes.size() << ", leafs: " << leafs << ", triangles: " << triangles << ")";
+    return out;
+}
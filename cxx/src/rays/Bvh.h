@@ -0,0 +1,48 @@
+#pragma once
+#include <vector>
+#include <glm/vec3.hpp>
+#include <Mesh.h>
+#include <settings.h>
+
+
+struct Aabb {
+    glm::vec3 min {infT};
+    glm::vec3 max {-infT};
+
+    void grow(const glm::vec3 &point);
+    void grow(const Aabb &aabb);
+
+    glm::vec3 center() const;
+    float surfaceArea() const;
+};
+
+struct BvhNode {
+    Aabb bounds;
+    // interior node: index of the left child, the right child is stored directly after it
+    // leaf node: index of the first primitive, replaced by its first triangle packet once packed
+    int first;
+    // amount of primitives in a leaf, 0 for interior nodes
+    int count;
+
+    bool isLeaf() const {
+        return count > 0;
+    }
+
+    int packetCount() const {
+        return (count + TRIANGLE_PACKET_SIZE - 1) / TRIANGLE_PACKET_SIZE;
+    }
+};
+
+struct Bvh {
+    std::vector<BvhNode> nodes;
+    // scene triangle indices in leaf order, consumed when the TriangleStore is packed
+    std::vector<int> primitives;
+
+    void build(const std::vector<SceneTriangle> &triangles);
+
+    bool empty() const {
+        return nodes.empty();
+    }
+};
+
+std::ostream &operator<<(std::ostream &out, const Bvh &bvh);
@@ -11,12 +11,16 @@ Energy Energy::complement() {
 }
 
 void Energy::multiply(const Energy &energy) {
+    average = -1;
+
     for (int i = 0; i < N_BANDS; i++) {
         this->values[i] *= energy.values[i];
     }
 }
 
 void Energy::multiply(const float energy) {
+    average = -1;
+
     for (int i = 0; i < N_BANDS; i++) {
         this->values[i] *= energy;
     }
@@ -31,6 +35,7 @@ float Energy::get_average() {
     for (int band = 0; band < N_BANDS; band++) {
         average += values[band];
     }
+    average /= N_BANDS;
 
     return average;
 }
@@ -11,6 +11,7 @@ struct Energy {
     void multiply(const Energy &energy);
     void multiply(const float energy);
 
+    // mean over the bands, cached until the next multiply
     float get_average();
 };
 
@@ -0,0 +1,340 @@
+#include "GaussianMixture.h"
+#include <settings.h>
+#include <ThreadPool.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// random stream of the fit, ray indices never reach it
+const uint32_t GMM_FIT_STREAM = 0xffffffff;
+
+
+struct EStepChunk {
+    std::vector<ComponentStatistics> statistics;
+    double log_likelihood = 0;
+};
+
+void ComponentStatistics::add(const ComponentStatistics &other) {
+    r += other.r;
+    rx += other.rx;
+    ry += other.ry;
+    rxx += other.rxx;
+    rxy += other.rxy;
+    ryy += other.ryy;
+}
+
+void ComponentStatistics::scale(double factor) {
+    r *= factor;
+    rx *= factor;
+    ry *= factor;
+    rxx *= factor;
+    rxy *= factor;
+    ryy *= factor;
+}
+
+void GaussianComponent::update() {
+    double det = cov_xx * cov_yy - cov_xy * cov_xy;
+
+    log_weight = std::log(weight);
+
+    inv_xx = cov_yy / det;
+    inv_xy = -cov_xy / det;
+    inv_yy = cov_xx / det;
+    log_norm = -std::log(2 * M_PI) - 0.5 * std::log(det);
+
+    chol_xx = std::sqrt(cov_xx);
+    chol_yx = cov_xy / chol_xx;
+    chol_yy = std::sqrt(std::max(cov_yy - chol_yx * chol_yx, 0.0));
+
+    reach_x = GMM_WRAP_SIGMAS * std::sqrt(cov_xx);
+    reach_y = GMM_WRAP_SIGMAS * std::sqrt(cov_yy);
+}
+
+double GaussianComponent::logDensity(double x, double y) const {
+    return logDensityOffset(x - mean_x, y - mean_y);
+}
+
+double GaussianComponent::logDensityOffset(double dx, double dy) const {
+    double mahalanobis = inv_xx * dx * dx + 2 * inv_xy * dx * dy + inv_yy * dy * dy;
+    return log_norm - 0.5 * mahalanobis;
+}
+
+// weights, means and covariances from the summed responsibilities
+void maximize(std::vector<GaussianComponent> &components, const std::vector<ComponentStatistics> &statistics, double n) {
+    for (int k = 0; k < components.size(); k++) {
+        const ComponentStatistics &s = statistics[k];
+        GaussianComponent &component = components[k];
+
+        // an empty component keeps its mean and shape, its weight becomes negligible
+        double r = std::max(s.r, 10 * std::numeric_limits<double>::epsilon());
+        component.weight = r / n;
+
+        if (s.r > 0) {
+            component.mean_x = s.rx / r;
+            component.mean_y = s.ry / r;
+            component.cov_xx = std::max(s.rxx / r - component.mean_x * component.mean_x, 0.0) + GMM_REG_COVAR;
+            component.cov_xy = s.rxy / r - component.mean_x * component.mean_y;
+            component.cov_yy = std::max(s.ryy / r - component.mean_y * component.mean_y, 0.0) + GMM_REG_COVAR;
+        }
+
+        component.update();
+    }
+}
+
+void eStepChunk(const std::vector<GaussianComponent> &components, const std::vector<InitNums> &hits, int s, int e, EStepChunk &chunk) {
+    int k_count = (int) components.size();
+    std::vector<double> log_p(k_count);
+    chunk.statistics.assign(k_count, {});
+    chunk.log_likelihood = 0;
+
+    for (int i = s; i < e; i++) {
+        double x = hits[i].projectedCoords.x;
+        double y = hits[i].projectedCoords.y;
+
+        double max_log_p = -INFINITY;
+        for (int k = 0; k < k_count; k++) {
+            log_p[k] = components[k].log_weight + components[k].logDensity(x, y);
+            max_log_p = std::max(max_log_p, log_p[k]);
+        }
+
+        double sum = 0;
+        for (int k = 0; k < k_count; k++) {
+            log_p[k] = std::exp(log_p[k] - max_log_p);
+            sum += log_p[k];
+        }
+
+        chunk.log_likelihood += max_log_p + std::log(sum);
+
+        for (int k = 0; k < k_count; k++) {
+            double r = log_p[k] / sum;
+            ComponentStatistics &statistics = chunk.statistics[k];
+            statistics.r += r;
+            statistics.rx += r * x;
+            statistics.ry += r * y;
+            statistics.rxx += r * x * x;
+            statistics.rxy += r * x * y;
+            statistics.ryy += r * y * y;
+        }
+    }
+}
+
+// k-means++ seeding followed by a few lloyd iterations, like sklearn's kmeans initialisation
+std::vector<int> kMeansLabels(const std::vector<InitNums> &hits, int k_count, int seed) {
+    int n = (int) hits.size();
+    Philox random {(uint32_t) seed, GMM_FIT_STREAM, 0};
+
+    auto distance2 = [&](int i, double x, double y) {
+        double dx = hits[i].projectedCoords.x - x;
+        double dy = hits[i].projectedCoords.y - y;
+        return dx * dx + dy * dy;
+    };
+
+    std::vector<double> means_x;
+    std::vector<double> means_y;
+    std::vector<double> nearest(n, INFINITY);
+
+    int first = std::min((int) (random.uniform() * n), n - 1);
+    means_x.push_back(hits[first].projectedCoords.x);
+    means_y.push_back(hits[first].projectedCoords.y);
+
+    while (means_x.size() < k_count) {
+        double total = 0;
+        for (int i = 0; i < n; i++) {
+            nearest[i] = std::min(nearest[i], distance2(i, means_x.back(), means_y.back()));
+            total += nearest[i];
+        }
+
+        // a point is picked with probability proportional to its squared distance to the closest mean
+        double target = random.uniform() * total;
+        int chosen = n - 1;
+        for (int i = 0; i < n; i++) {
+            target -= nearest[i];
+            if (target < 0) {
+                chosen = i;
+                break;
+            }
+        }
+
+        means_x.push_back(hits[chosen].projectedCoords.x);
+        means_y.push_back(hits[chosen].projectedCoords.y);
+    }
+
+    std::vector<int> labels(n, 0);
+    for (int iteration = 0; iteration < GMM_KMEANS_ITERATIONS; iteration++) {
+        std::vector<double> sum_x(k_count, 0);
+        std::vector<double> sum_y(k_count, 0);
+        std::vector<int> count(k_count, 0);
+
+        for (int i = 0; i < n; i++) {
+            double best = INFINITY;
+            for (int k = 0; k < k_count; k++) {
+                double d = distance2(i, means_x[k], means_y[k]);
+                if (d < best) {
+                    best = d;
+                    labels[i] = k;
+                }
+            }
+
+            sum_x[labels[i]] += hits[i].projectedCoords.x;
+            sum_y[labels[i]] += hits[i].projectedCoords.y;
+            count[labels[i]]++;
+        }
+
+        for (int k = 0; k < k_count; k++) {
+            if (count[k] > 0) {
+                means_x[k] = sum_x[k] / count[k];
+                means_y[k] = sum_y[k] / count[k];
+            }
+        }
+    }
+
+    return labels;
+}
+
+void GaussianMixture::initialize(const std::vector<InitNums> &hits, int seed) {
+    int n = (int) hits.size();
+    int k_count = std::min(GMM_COMPONENTS, n);
+    components.assign(k_count, {});
+
+    // hard assignment of the k-means labels as the first responsibilities
+    std::vector<int> labels = kMeansLabels(hits, k_count, seed);
+    std::vector<ComponentStatistics> statistics(k_count);
+    for (int i = 0; i < n; i++) {
+        double x = hits[i].projectedCoords.x;
+        double y = hits[i].projectedCoords.y;
+        ComponentStatistics &s = statistics[labels[i]];
+        s.r += 1;
+        s.rx += x;
+        s.ry += y;
+        s.rxx += x * x;
+        s.rxy += x * y;
+        s.ryy += y * y;
+    }
+
+    for (GaussianComponent &component : components) {
+        component.mean_x = 0.5;
+        component.mean_y = 0.5;
+        component.cov_xx = 1.0 / 12.0;
+        component.cov_xy = 0;
+        component.cov_yy = 1.0 / 12.0;
+    }
+    maximize(components, statistics, n);
+}
+
+int GaussianMixture::fit(const std::vector<InitNums> &hits, int seed) {
+    int n = (int) hits.size();
+    if (n == 0) {
+        return 0;
+    }
+
+    // the history belongs to the current components, a cold start forgets it. A mixture that was first fitted to fewer
+    // hits than GMM_COMPONENTS starts over once there are hits for more components
+    bool can_grow = (int) components.size() < std::min(GMM_COMPONENTS, n);
+    std::vector<ComponentStatistics> prior;
+    double prior_hits = 0;
+    if (GMM_WARM_START && !empty() && !can_grow) {
+        prior = history;
+        prior_hits = history_hits * GMM_HIT_DECAY;
+        for (ComponentStatistics &statistics : prior) {
+            statistics.scale(GMM_HIT_DECAY);
+        }
+    } else {
+        initialize(hits, seed);
+    }
+
+    int k_count = (int) components.size();
+    prior.resize(k_count);
+    std::vector<ComponentStatistics> statistics;
+
+    int chunks = (n + GMM_CHUNK_SIZE - 1) / GMM_CHUNK_SIZE;
+    std::vector<EStepChunk> eStep(chunks);
+    double previous_log_likelihood = -INFINITY;
+
+    int iteration = 0;
+    while (iteration < GMM_MAX_ITERATIONS) {
+        iteration++;
+
+        threadPool().parallelFor(0, n, GMM_CHUNK_SIZE, [&](int worker, int s, int e) {
+            eStepChunk(components, hits, s, e, eStep[s / GMM_CHUNK_SIZE]);
+        });
+
+        // summed in chunk order, the fit does not depend on the amount of threads
+        double log_likelihood = 0;
+        statistics = prior;
+        for (const EStepChunk &chunk : eStep) {
+            log_likelihood += chunk.log_likelihood;
+
+            for (int k = 0; k < k_count; k++) {
+                statistics[k].add(chunk.statistics[k]);
+            }
+        }
+
+        maximize(components, statistics, n + prior_hits);
+
+        log_likelihood /= n;
+        if (std::abs(log_likelihood - previous_log_likelihood) < GMM_TOLERANCE) {
+            break;
+        }
+        previous_log_likelihood = log_likelihood;
+    }
+
+    history = statistics;
+    history_hits = n + prior_hits;
+
+    cumulative_weights.clear();
+    double total = 0;
+    for (const GaussianComponent &component : components) {
+        total += component.weight;
+        cumulative_weights.push_back(total);
+    }
+
+    return iteration;
+}
+
+double GaussianMixture::pdf(double x, double y) const {
+    double density = 0;
+    for (const GaussianComponent &component : components) {
+        double dx = x - component.mean_x;
+        double dy = y - component.mean_y;
+        int images_x = 1 + (int) std::ceil(component.reach_x);
+        int images_y = 1 + (int) std::ceil(component.reach_y);
+
+        for (int i = -images_x; i <= images_x; i++) {
+            if (std::abs(dx + i) > component.reach_x) {
+                continue;
+            }
+
+            for (int j = -images_y; j <= images_y; j++) {
+                if (std::abs(dy + j) > component.reach_y) {
+                    continue;
+                }
+
+                density += component.weight * std::exp(component.logDensityOffset(dx + i, dy + j));
+            }
+        }
+    }
+    return density;
+}
+
+ProjectedCoords GaussianMixture::draw(Philox &random) const {
+    double u = random.uniform() * cumulative_weights.back();
+    int k = (int) (std::upper_bound(cumulative_weights.begin(), cumulative_weights.end(), u) - cumulative_weights.begin());
+    const GaussianComponent &component = components[std::min(k, (int) components.size() - 1)];
+
+    // box muller
+    double radius = std::sqrt(-2 * std::log(1 - random.uniform()));
+    double angle = 2 * M_PI * random.uniform();
+    double z_0 = radius * std::cos(angle);
+    double z_1 = radius * std::sin(angle);
+
+    double x = component.mean_x + component.chol_xx * z_0;
+    double y = component.mean_y + component.chol_yx * z_0 + component.chol_yy * z_1;
+
+    // the projection is periodic over [0, 1)
+    x -= std::floor(x);
+    y -= std::floor(y);
+    x = x >= 1.0 ? 0.0 : x;
+    y = y >= 1.0 ? 0.0 : y;
+
+    return {x, y};
+}
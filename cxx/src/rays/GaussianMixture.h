@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+#include "directionGenerator.h"
+#include "philox.h"
+
+
+struct GaussianComponent {
+    double weight;
+    double mean_x;
+    double mean_y;
+    double cov_xx;
+    double cov_xy;
+    double cov_yy;
+
+    // derived from the weight and covariance by update()
+    double log_weight;
+    double inv_xx;
+    double inv_xy;
+    double inv_yy;
+    double log_norm;
+    double chol_xx;
+    double chol_yx;
+    double chol_yy;
+    double reach_x;
+    double reach_y;
+
+    void update();
+    double logDensity(double x, double y) const;
+    double logDensityOffset(double dx, double dy) const;
+};
+
+// responsibility weighted sums of the hits, enough to redo the M-step without the hits themselves
+struct ComponentStatistics {
+    double r = 0;
+    double rx = 0;
+    double ry = 0;
+    double rxx = 0;
+    double rxy = 0;
+    double ryy = 0;
+
+    void add(const ComponentStatistics &other);
+    void scale(double factor);
+};
+
+// 2D mixture with full covariances over the projected coords, the native counterpart of sklearn's GaussianMixture.
+struct GaussianMixture {
+    std::vector<GaussianComponent> components;
+    std::vector<double> cumulative_weights;
+
+    // statistics of every hit fitted so far, the weight of a hit decays by GMM_HIT_DECAY per later fit
+    std::vector<ComponentStatistics> history;
+    double history_hits = 0;
+
+    bool empty() const {
+        return components.empty();
+    }
+
+    // EM with at most GMM_MAX_ITERATIONS iterations, returns the iterations used.
+    // Starts from the current mixture and the decayed history when GMM_WARM_START is on, from k-means++ seeded by seed otherwise.
+    int fit(const std::vector<InitNums> &hits, int seed);
+
+    // k-means++ seeded by seed, followed by one M-step on the hard labels
+    void initialize(const std::vector<InitNums> &hits, int seed);
+
+    // density of the wrapped samples, the sum over the periodic images of every component
+    double pdf(double x, double y) const;
+
+    // a sample wrapped into [0, 1)
+    ProjectedCoords draw(Philox &random) const;
+};
@@ -2,48 +2,16 @@
 
 #include "Gmm.h"
 #include "RayTracing.h"
-#include <fstream>
-#include <boost/tokenizer.hpp>
+#include <TraceReception.h>
 
 
-std::vector<InitNums> Gmm::pythonNewDirectionCoords(const std::vector<InitNums> &coords, int num_directions) {
-    // Create a temporary CSV file
-    std::ofstream tempFile("./Postprocessing/io/hitCoords.csv");
-    tempFile << "x,y" << std::endl;
-    for (const auto& coord : coords) {
-        tempFile << coord.projectedCoords.x << "," << coord.projectedCoords.y << std::endl;
-    }
-    tempFile.close();
-
-    // Execute the Python script and pass the temporary CSV file as an argument
-    std::cout << "Loading python......" << std::flush;
-    std::string command = "/usr/bin/python3 ./Postprocessing/hitCoords.py ./Postprocessing/io/hitCoords.csv ./Postprocessing/io/newDirectionsCoords.csv " + std::to_string(num_directions);
-    int result = system(command.c_str());
-    std::cout << "\rPython loaded" << std::endl;
-
-
-    // Read the output of the Python script
-    std::vector<InitNums> newCoords;
-    std::string line;
-    std::ifstream outputFile("./Postprocessing/io/newDirectionsCoords.csv");
-
-    while (std::getline(outputFile, line)) {
-        boost::tokenizer<boost::escaped_list_separator<char>> tokens(line);
-        std::vector<std::string> vec(tokens.begin(), tokens.end());
-        newCoords.emplace_back(InitNums{ProjectedCoords{std::stod(vec[0]), std::stod(vec[1])}, std::stod(vec[2])});
-    }
-
-    outputFile.close();
-    return newCoords;
-
-}
-
 std::vector<InitNums> Gmm::findHitProjectionCoords(std::vector<Ray> &all_rays) {
     Sphere receiverSphere {global_config->RECEIVER_LOCATION, global_config->RECEIVER_RADIUS};
     std::vector<InitNums> coords;
 
     for (Ray &ray : all_rays) {
-        if (!intersectWithSphere(receiverSphere, ray).has_value()) {
+        // slots no path of the last pass has reached
+        if (ray.ray_start_index < 0 || !intersectWithSphere(receiverSphere, ray).has_value()) {
             continue;
         }
 
@@ -53,24 +21,74 @@ std::vector<InitNums> Gmm::findHitProjectionCoords(std::vector<Ray> &all_rays) {
     return coords;
 }
 
-void Gmm::generateRays(std::vector <Ray> &all_rays, glm::vec3 startPoint, RaySettings &ray_settings, int seed) {
+// Draws from the fitted proposal, or uniformly for a DEFENSIVE_FRACTION of the rays.
+// The probability of a ray is the pdf of that whole mixture, wherever the sample came from.
+template<typename Proposal>
+DirectionSource proposalSource(const Proposal &proposal, int seed) {
+    double defensive_fraction = global_config->DEFENSIVE_FRACTION;
+
+    return [proposal, seed, defensive_fraction](std::vector<StartingDirection> &directions, int first_ray, int count) {
+        std::vector<InitNums> coords;
+        coords.reserve(count);
+
+        for (int ray = first_ray; ray < first_ray + count; ray++) {
+            Philox random {(uint32_t) seed, (uint32_t) ray, 0};
+
+            ProjectedCoords projectedCoords;
+            if (defensive_fraction > 0 && random.uniform() < defensive_fraction) {
+                projectedCoords = {random.uniform(), random.uniform()};
+            } else {
+                projectedCoords = proposal.draw(random);
+            }
+
+            double probability = defensive_fraction + (1 - defensive_fraction) * proposal.pdf(projectedCoords.x, projectedCoords.y);
+            coords.emplace_back(projectedCoords, probability);
+        }
+
+        directions = generateDirectionsFromCoords(coords);
+    };
+}
+
+DirectionSource Gmm::directionSource(const std::vector<InitNums> &hitProjectionCoords, int seed) {
     if (!initialized) {
-        ::generateRays(all_rays, startPoint, ray_settings, seed);
         initialized = true;
-        return;
+        return uniformDirectionSource(seed);
     }
 
-    std::vector<InitNums> hitProjectionCoords = findHitProjectionCoords(all_rays);
-    std::vector<InitNums> newDirectionProjectionCoords = pythonNewDirectionCoords(hitProjectionCoords, ray_settings.amount_of_rays);
+    if (hitProjectionCoords.empty()) {
+        std::cout << "No rays reached the receiver, sampling uniformly" << std::endl;
+        return uniformDirectionSource(seed);
+    }
+
+    if (global_config->PROPOSAL_METHOD == TABULATED_PROPOSAL) {
+        tabulated.fit(hitProjectionCoords);
+        std::cout << "Tabulated " << hitProjectionCoords.size() << " hits in " << tabulated.cells.size() << " cells" << std::endl;
+
+        return proposalSource(tabulated, seed);
+    }
+
+    int iterations = mixture.fit(hitProjectionCoords, seed);
+    std::cout << "Fitted " << mixture.components.size() << " gaussians to " << hitProjectionCoords.size() << " hits in " << iterations << " iterations" << std::endl;
+
+    return proposalSource(mixture, seed);
+}
+
+void Gmm::generateRays(std::vector <Ray> &all_rays, glm::vec3 startPoint, RaySettings &ray_settings, int seed, TraceReception *reception) {
+    std::vector<InitNums> hitProjectionCoords;
+    if (initialized && reception != nullptr && reception->valid) {
+        hitProjectionCoords = std::move(reception->hitCoords);
+    } else if (initialized) {
+        hitProjectionCoords = findHitProjectionCoords(all_rays);
+    }
 
-    std::vector<StartingDirection> directions = generateDirectionsFromCoords(newDirectionProjectionCoords);
-    generateRaysFromDirections(all_rays, startPoint, ray_settings, directions);
-    return;
+    std::vector<StartingDirection> directions;
+    directionSource(hitProjectionCoords, seed)(directions, 0, ray_settings.amount_of_rays);
+    generateRaysFromDirections(all_rays, startPoint, ray_settings, directions, seed, reception);
 }
 
 
-void generateRays(std::vector<Ray> &all_rays, glm::vec3 startPoint, RaySettings &ray_settings, int seed) {
+void generateRays(std::vector<Ray> &all_rays, glm::vec3 startPoint, RaySettings &ray_settings, int seed, TraceReception *reception) {
     GenerateDirections generateDirections {seed};
     std::vector<StartingDirection> directions = generateDirections.generateDirections(ray_settings.amount_of_rays);
-    generateRaysFromDirections(all_rays, startPoint, ray_settings, directions);
+    generateRaysFromDirections(all_rays, startPoint, ray_settings, directions, seed, reception);
 }
@@ -1,20 +1,26 @@
 
 
 #pragma once
-#include "ray.h"
+#include "Ray.h"
+#include "GaussianMixture.h"
+#include "TabulatedProposal.h"
 
 
 class Gmm {
 
 public:
     bool initialized = false;
+    GaussianMixture mixture;
+    TabulatedProposal tabulated;
 
-    void generateRays(std::vector<Ray> &all_rays, glm::vec3 startPoint, RaySettings &ray_settings, int seed);
+    // the hits of the previous iteration come from the reception when it holds them, from a sweep over all_rays otherwise
+    void generateRays(std::vector<Ray> &all_rays, glm::vec3 startPoint, RaySettings &ray_settings, int seed, TraceReception *reception = nullptr);
 
     std::vector<InitNums> findHitProjectionCoords(std::vector<Ray> &all_rays);
 
-    std::vector<InitNums> pythonNewDirectionCoords(const std::vector<InitNums> &coords, int num_directions);
+    // directions of the next iteration: uniform the first time, sampled from the hits of the previous iteration afterwards
+    DirectionSource directionSource(const std::vector<InitNums> &hitProjectionCoords, int seed);
 };
 
-void generateRays(std::vector<Ray> &all_rays, glm::vec3 startPoint, RaySettings &ray_settings, int seed);
+void generateRays(std::vector<Ray> &all_rays, glm::vec3 startPoint, RaySettings &ray_settings, int seed, TraceReception *reception);
 
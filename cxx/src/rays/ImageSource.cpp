@@ -0,0 +1,179 @@
+#include "ImageSource.h"
+#include "RayTracing.h"
+#include <settings.h>
+#include <glm/geometric.hpp>
+#include <ThreadPool.h>
+
+
+// true when part of wall lies strictly on the given side of the plane of other
+static bool hasPartOnSide(const Wall &wall, const Wall &other, float side) {
+    for (const SceneTriangle &triangle : wall.triangles) {
+        for (const glm::vec3 &vertex : {triangle.vertex_0, triangle.vertex_1, triangle.vertex_2}) {
+            if (other.distance(vertex) * side > IMAGE_SOURCE_PLANE_TOLERANCE) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void ImageSourceTree::build(const RaySettings &ray_settings, const glm::vec3 &source, int max_order) {
+    const std::vector<Wall> &walls = ray_settings.walls;
+    images.clear();
+
+    images.push_back({source, -1, -1, 0});
+
+    // breadth first, so the images are ordered by reflection order
+    for (int parent_i = 0; parent_i < images.size(); parent_i++) {
+        if (images.at(parent_i).order >= max_order) {
+            break;
+        }
+
+        for (int wall_i = 0; wall_i < walls.size(); wall_i++) {
+            const ImageSource &parent = images.at(parent_i);
+            const Wall &wall = walls.at(wall_i);
+
+            if (wall_i == parent.wall) {
+                continue;
+            }
+
+            float distance = wall.distance(parent.position);
+            if (std::abs(distance) < IMAGE_SOURCE_PLANE_TOLERANCE) {
+                continue;
+            }
+
+            // after a reflection the sound travels on the side of the mirror facing away from the image
+            if (parent.wall >= 0) {
+                const Wall &mirror = walls.at(parent.wall);
+                float side = mirror.distance(parent.position) > 0 ? -1.0f : 1.0f;
+
+                if (!hasPartOnSide(wall, mirror, side)) {
+                    continue;
+                }
+            }
+
+            // the rays no longer deposit these orders, a partial order would lose energy without notice
+            if (images.size() >= IMAGE_SOURCE_MAX_IMAGES) {
+                std::cerr << "More than " << IMAGE_SOURCE_MAX_IMAGES << " image sources up to order " << max_order
+                          << ", lower the image source order" << std::endl;
+                throw std::exception();
+            }
+
+            glm::vec3 position = parent.position - 2 * distance * wall.normal;
+            int order = parent.order + 1;
+            images.push_back({position, wall_i, parent_i, order});
+        }
+    }
+}
+
+// visibility between two points, ignoring the walls the points lie on
+static bool isVisible(const glm::vec3 &from, const glm::vec3 &to, const RaySettings &ray_settings) {
+    glm::vec3 to_target = to - from;
+    float distance = glm::length(to_target);
+
+    if (distance <= 2 * IMAGE_SOURCE_SURFACE_OFFSET) {
+        return true;
+    }
+
+    glm::vec3 offset = to_target * (IMAGE_SOURCE_SURFACE_OFFSET / distance);
+    return !isOccluded(from + offset, to - offset, ray_settings);
+}
+
+// The material that reflects at point on wall, from the closest hit along the segment from target through the acceleration
+// structure, which also checks that nothing blocks the segment. nullptr when the segment is blocked or point lies in a hole
+// of the wall.
+static AudioReflection *reflectingMaterial(const Wall &wall, const glm::vec3 &target, const glm::vec3 &point, const RaySettings &ray_settings) {
+    if (!wall.mayContain(point)) {
+        return nullptr;
+    }
+
+    glm::vec3 to_point = point - target;
+    float distance = glm::length(to_point);
+    float start = std::min(IMAGE_SOURCE_SURFACE_OFFSET, distance / 2);
+
+    Ray segment {target + to_point * (start / distance), to_point / distance};
+    segment.t = distance - start + IMAGE_SOURCE_SURFACE_OFFSET;
+    detectHit(segment, ray_settings);
+
+    if (!segment.hit || segment.t < distance - start - IMAGE_SOURCE_SURFACE_OFFSET) {
+        return nullptr;
+    }
+
+    // a triangle of the wall, not one that only touches its plane
+    const HitInfo &hit = segment.hitInfo;
+    if (std::abs(wall.distance(hit.hitPoint)) > IMAGE_SOURCE_PLANE_TOLERANCE ||
+        std::abs(glm::dot(hit.hitNormal, wall.normal)) < 1 - IMAGE_SOURCE_PLANE_TOLERANCE) {
+        return nullptr;
+    }
+
+    return hit.hitAudioReflection;
+}
+
+std::optional<SpecularPath> ImageSourceTree::tracePath(int image, const glm::vec3 &receiver, const RaySettings &ray_settings) const {
+    const std::vector<Wall> &walls = ray_settings.walls;
+    const ImageSource &last = images.at(image);
+    Energy energy OneEnergyTemplate;
+    glm::vec3 target = receiver;
+
+    // walks back from the receiver, every image fixes the next reflection point
+    for (int node = image; node != -1; node = images.at(node).parent) {
+        const ImageSource &imageSource = images.at(node);
+
+        if (imageSource.wall == -1) {
+            if (!isVisible(target, imageSource.position, ray_settings)) {
+                return std::nullopt;
+            }
+
+            glm::vec3 direction = glm::normalize(target - imageSource.position);
+            glm::vec3 arrival = glm::normalize(receiver - last.position);
+            return SpecularPath {glm::length(receiver - last.position), last.order, direction, arrival, energy};
+        }
+
+        const Wall &wall = walls.at(imageSource.wall);
+        float target_distance = wall.distance(target);
+        float image_distance = wall.distance(imageSource.position);
+
+        if (target_distance * image_distance >= 0) {
+            return std::nullopt;
+        }
+
+        float s = target_distance / (target_distance - image_distance);
+        glm::vec3 reflectionPoint = target + s * (imageSource.position - target);
+
+        AudioReflection *reflection = reflectingMaterial(wall, target, reflectionPoint, ray_settings);
+        if (reflection == nullptr) {
+            return std::nullopt;
+        }
+
+        energy.multiply(reflection->absorption_coefficient.complement());
+        energy.multiply(reflection->scattering_coefficient.complement());
+
+        target = reflectionPoint;
+    }
+
+    return std::nullopt;
+}
+
+std::vector<SpecularPath> ImageSourceTree::findPaths(const glm::vec3 &receiver, const RaySettings &ray_settings) const {
+    int n = (int) images.size();
+    std::vector<std::vector<SpecularPath>> chunkPaths((n + RAY_CHUNK_SIZE - 1) / RAY_CHUNK_SIZE);
+
+    threadPool().parallelFor(0, n, RAY_CHUNK_SIZE, [&](int worker, int s, int e) {
+        for (int image = s; image < e; image++) {
+            std::optional<SpecularPath> path = tracePath(image, receiver, ray_settings);
+
+            if (path.has_value()) {
+                chunkPaths.at(s / RAY_CHUNK_SIZE).push_back(path.value());
+            }
+        }
+    });
+
+    // in image order whatever the scheduling
+    std::vector<SpecularPath> paths;
+    for (std::vector<SpecularPath> &chunk : chunkPaths) {
+        paths.insert(paths.end(), chunk.begin(), chunk.end());
+    }
+
+    return paths;
+}
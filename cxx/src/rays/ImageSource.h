@@ -0,0 +1,39 @@
+#pragma once
+#include <vector>
+#include <glm/vec3.hpp>
+#include "Ray.h"
+
+
+struct ImageSource {
+    glm::vec3 position;
+    // wall that mirrored the parent into this image, -1 for the source itself
+    int wall;
+    int parent;
+    int order;
+};
+
+struct SpecularPath {
+    float length;
+    int order;
+    // leaving the source
+    glm::vec3 direction;
+    // into the receiver, along the line from the last image
+    glm::vec3 arrival;
+    // product of (1 - absorption) * (1 - scattering) of the reflecting triangles, the specular energy the ray tracer keeps
+    Energy energy;
+};
+
+// Image source method for the specular reflections of order 0 to max_order, mirrored in the walls of ray_settings.
+// The images only depend on the source and the walls, so they are built once and reused for every receiver.
+struct ImageSourceTree {
+    std::vector<ImageSource> images;
+
+    // throws when the orders up to max_order need more than IMAGE_SOURCE_MAX_IMAGES images
+    void build(const RaySettings &ray_settings, const glm::vec3 &source, int max_order);
+
+    // the valid paths from the source to receiver, visibility is checked through the acceleration structure
+    std::vector<SpecularPath> findPaths(const glm::vec3 &receiver, const RaySettings &ray_settings) const;
+
+private:
+    std::optional<SpecularPath> tracePath(int image, const glm::vec3 &receiver, const RaySettings &ray_settings) const;
+};
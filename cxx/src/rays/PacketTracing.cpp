@@ -0,0 +1,182 @@
+#include "PacketTracing.h"
+#include "RayTracing.h"
+#include <algorithm>
+#include <cstdint>
+
+
+// Bounds on the slab distances of every ray in a packet with a shared origin.
+// Only usable when all directions have the same sign per axis, otherwise the inverse directions are unbounded.
+struct PacketFrustum {
+    bool valid = true;
+    glm::vec3 origin;
+    glm::vec3 min_inverse {infT};
+    glm::vec3 max_inverse {-infT};
+    bool negative[3];
+
+    PacketFrustum(const Ray *rays, const glm::vec3 *inverseDirections, int count) {
+        origin = rays[0].origin;
+
+        for (int axis = 0; axis < 3; axis++) {
+            negative[axis] = rays[0].direction[axis] < 0;
+        }
+
+        for (int i = 0; i < count; i++) {
+            for (int axis = 0; axis < 3; axis++) {
+                float d = rays[i].direction[axis];
+                if (std::abs(d) < EPSILON || (d < 0) != negative[axis]) {
+                    valid = false;
+                    return;
+                }
+            }
+
+            min_inverse = glm::min(min_inverse, inverseDirections[i]);
+            max_inverse = glm::max(max_inverse, inverseDirections[i]);
+        }
+    }
+
+    // conservative, false only when no ray of the packet can enter the box before max_t
+    bool mayHit(const Aabb &aabb, float max_t) const {
+        float enter_lower = -infT;
+        float exit_upper = infT;
+
+        for (int axis = 0; axis < 3; axis++) {
+            float near_plane = negative[axis] ? aabb.max[axis] : aabb.min[axis];
+            float far_plane = negative[axis] ? aabb.min[axis] : aabb.max[axis];
+
+            float near_distance = near_plane - origin[axis];
+            float far_distance = far_plane - origin[axis];
+
+            enter_lower = std::max(enter_lower, std::min(near_distance * min_inverse[axis], near_distance * max_inverse[axis]));
+            exit_upper = std::min(exit_upper, std::max(far_distance * min_inverse[axis], far_distance * max_inverse[axis]));
+        }
+
+        return enter_lower <= exit_upper && exit_upper >= 0 && enter_lower < max_t;
+    }
+};
+
+struct PacketStackEntry {
+    int node;
+    // rays before this one are known to miss the node
+    int first_active;
+};
+
+// index of the first ray from first_active that hits the box, count when none does
+static int firstActiveRay(const Aabb &aabb, const Ray *rays, const glm::vec3 *inverseDirections, int first_active, int count, float &entry_t) {
+    for (int i = first_active; i < count; i++) {
+        if (intersectWithAabb(aabb, rays[i].origin, inverseDirections[i], rays[i].t, entry_t)) {
+            return i;
+        }
+    }
+
+    return count;
+}
+
+void detectHitPacket(Ray *rays, int count, const RaySettings &ray_settings) {
+    const Bvh &bvh = ray_settings.bvh;
+
+    if (!USE_BVH || bvh.empty()) {
+        for (int i = 0; i < count; i++) {
+            detectHit(rays[i], ray_settings);
+        }
+        return;
+    }
+
+    glm::vec3 inverseDirections[RAY_PACKET_SIZE];
+    for (int i = 0; i < count; i++) {
+        inverseDirections[i] = 1.0f / rays[i].direction;
+    }
+
+    PacketFrustum frustum {rays, inverseDirections, count};
+
+    PacketStackEntry stack[BVH_STACK_SIZE];
+    int stack_size = 0;
+    stack[stack_size++] = {0, 0};
+
+    while (stack_size > 0) {
+        PacketStackEntry entry = stack[--stack_size];
+        const BvhNode &node = bvh.nodes[entry.node];
+
+        if (frustum.valid) {
+            float max_t = 0.0f;
+            for (int i = entry.first_active; i < count; i++) {
+                max_t = std::max(max_t, rays[i].t);
+            }
+
+            if (!frustum.mayHit(node.bounds, max_t)) {
+                continue;
+            }
+        }
+
+        float entry_t;
+        int first_active = firstActiveRay(node.bounds, rays, inverseDirections, entry.first_active, count, entry_t);
+        if (first_active == count) {
+            continue;
+        }
+
+        if (node.isLeaf()) {
+            // the packets of the leaf stay in cache for every ray
+            for (int i = first_active; i < count; i++) {
+                float ray_entry_t;
+                if (i != first_active && !intersectWithAabb(node.bounds, rays[i].origin, inverseDirections[i], rays[i].t, ray_entry_t)) {
+                    continue;
+                }
+
+                for (int packet = node.first; packet < node.first + node.packetCount(); packet++) {
+                    intersectWithPacket(rays[i], ray_settings, packet);
+                }
+            }
+            continue;
+        }
+
+        // order the children by the first active ray, its neighbours share the order
+        const Ray &ray = rays[first_active];
+        float left_t;
+        float right_t;
+        bool hit_left = intersectWithAabb(bvh.nodes[node.first].bounds, ray.origin, inverseDirections[first_active], infT, left_t);
+        bool hit_right = intersectWithAabb(bvh.nodes[node.first + 1].bounds, ray.origin, inverseDirections[first_active], infT, right_t);
+
+        bool left_first = hit_left && (!hit_right || left_t <= right_t);
+        if (left_first) {
+            stack[stack_size++] = {node.first + 1, first_active};
+            stack[stack_size++] = {node.first, first_active};
+        } else {
+            stack[stack_size++] = {node.first, first_active};
+            stack[stack_size++] = {node.first + 1, first_active};
+        }
+    }
+}
+
+static uint32_t spreadBits(uint32_t x) {
+    // insert a zero between each of the lower 16 bits
+    x &= 0x0000ffff;
+    x = (x | (x << 8)) & 0x00ff00ff;
+    x = (x | (x << 4)) & 0x0f0f0f0f;
+    x = (x | (x << 2)) & 0x33333333;
+    x = (x | (x << 1)) & 0x55555555;
+    return x;
+}
+
+static uint32_t mortonCode2D(const ProjectedCoords &coords) {
+    uint32_t x = (uint32_t) (std::min(std::max(coords.x, 0.0), 1.0) * 0xffff);
+    uint32_t y = (uint32_t) (std::min(std::max(coords.y, 0.0), 1.0) * 0xffff);
+    return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+std::vector<int> coherentDirectionOrder(const std::vector<StartingDirection> &directions, int start, int end) {
+    std::vector<std::pair<uint32_t, int>> keys;
+    keys.reserve(end - start);
+
+    for (int i = start; i < end; i++) {
+        keys.emplace_back(mortonCode2D(directions.at(i).initNums.projectedCoords), i);
+    }
+
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<int> order;
+    order.reserve(keys.size());
+    for (auto &key : keys) {
+        order.push_back(key.second);
+    }
+
+    return order;
+}
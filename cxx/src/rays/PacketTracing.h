@@ -0,0 +1,10 @@
+#pragma once
+#include <vector>
+#include "Ray.h"
+
+
+// Closest hit for up to RAY_PACKET_SIZE rays that share their origin, traversing the bvh once for the whole packet.
+void detectHitPacket(Ray *rays, int count, const RaySettings &ray_settings);
+
+// Indices [start, end) ordered along a z-curve over their projected coordinates, neighbouring rays get similar directions.
+std::vector<int> coherentDirectionOrder(const std::vector<StartingDirection> &directions, int start, int end);
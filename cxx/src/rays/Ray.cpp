@@ -4,105 +4,197 @@
 #include "Ray.h"
 #include "RayTracing.h"
 #include "directionGenerator.h"
+#include "PacketTracing.h"
+#include "Wavefront.h"
+#include "philox.h"
+#include "lowDiscrepancy.h"
 #include <vector>
 #include <boost/range/irange.hpp>
-#include <thread>
 #include <random>
+#include <ThreadPool.h>
 
 
-void calculatePlaneNormal(VertexTriangle &triangle) {
-    triangle.planeNormal = glm::normalize(glm::cross(triangle.vertex_0.p - triangle.vertex_2.p, triangle.vertex_1.p - triangle.vertex_2.p));
-    triangle.planeD = glm::dot(triangle.planeNormal, triangle.vertex_0.p);
-}
-
 void initialize_meshes(RaySettings &ray_settings) {
-    // create all vertexTriangles
-    for (Mesh &mesh : ray_settings.meshes) {
-        for (Triangle triangle: mesh.triangles) {
-            VertexTriangle currentVertexTriangle{
-                    mesh.vertices.at(triangle.x),
-                    mesh.vertices.at(triangle.y),
-                    mesh.vertices.at(triangle.z)
-            };
+    std::vector<SceneTriangle> sceneTriangles = collectSceneTriangles(ray_settings.meshes);
 
-            calculatePlaneNormal(currentVertexTriangle);
+    // acceleration structure over all triangles, used by detectHit
+    if (USE_BVH) {
+        ray_settings.bvh.build(sceneTriangles);
+        std::cout << "Built " << ray_settings.bvh << std::endl;
+    }
 
+    ray_settings.triangles.build(sceneTriangles, ray_settings.bvh);
+    std::cout << "Triangle store: " << ray_settings.triangles.bytes() / 1024 << " KiB" << std::endl;
+}
 
-            mesh.vertexTriangles.push_back(currentVertexTriangle);
-        }
-    }
+void initialize_walls(RaySettings &ray_settings) {
+    ray_settings.walls = collectWalls(collectSceneTriangles(ray_settings.meshes));
+    std::cout << "Image source walls: " << ray_settings.walls.size() << std::endl;
 }
 
-void castRayIteration(int i, std::vector<Ray> &all_rays, glm::vec3 &startPoint, std::vector<StartingDirection> &directions,
-                      RaySettings &ray_settings, int block, GenerateDirections *generateDirections, int* ptotal_rays_done) {
-    int s = i * block;
-    int e = s + block;
+void castRayIteration(int s, int e, std::vector<Ray> &all_rays, glm::vec3 &startPoint, std::vector<StartingDirection> &directions,
+                      RaySettings &ray_settings, int seed, int* ptotal_rays_done) {
+    if (PACKET_TRACING) {
+        castRayPackets(all_rays, startPoint, directions, ray_settings, s, e, seed, ptotal_rays_done);
+        return;
+    }
+
     for (int ray_i = s; ray_i < e; ray_i++) {
         if (ray_i % 10000 == 0) {
             std::cout << "\rCasting rays: ";
             std::cout << *ptotal_rays_done << "/" << ray_settings.amount_of_rays;
             *ptotal_rays_done += 10000;
         }
-        castRay(all_rays, startPoint, directions.at(ray_i), ray_settings, ray_i, generateDirections);
+        castRay(all_rays, startPoint, directions.at(ray_i), ray_settings, ray_i, seed);
     }
 }
 
+void castRayPackets(std::vector<Ray> &all_rays, glm::vec3 &startPoint, std::vector<StartingDirection> &directions,
+                    RaySettings &ray_settings, int s, int e, int seed, int* ptotal_rays_done) {
+    // bundle rays with neighbouring directions so the first bounce shares its bvh traversal
+    std::vector<int> order = coherentDirectionOrder(directions, s, e);
+    Ray packet[RAY_PACKET_SIZE];
 
-void generateRaysFromDirections(std::vector<Ray> &all_rays, glm::vec3 startPoint, RaySettings &ray_settings,
-                                std::vector<StartingDirection> &directions) {
-    int block = ray_settings.amount_of_rays / NUM_THREADS;
-    std::vector<std::thread> threads = std::vector<std::thread>();
+    for (int packet_start = 0; packet_start < order.size(); packet_start += RAY_PACKET_SIZE) {
+        int count = std::min(RAY_PACKET_SIZE, (int) order.size() - packet_start);
+
+        for (int i = 0; i < count; i++) {
+            int ray_i = order.at(packet_start + i);
+            packet[i] = createFirstRay(startPoint, directions.at(ray_i), ray_i, seed);
+        }
+
+        detectHitPacket(packet, count, ray_settings);
+
+        for (int i = 0; i < count; i++) {
+            int ray_i = order.at(packet_start + i);
 
+            if (ray_i % 10000 == 0) {
+                std::cout << "\rCasting rays: ";
+                std::cout << *ptotal_rays_done << "/" << ray_settings.amount_of_rays;
+                *ptotal_rays_done += 10000;
+            }
+
+            all_rays.at(ray_i) = packet[i];
+            castReflections(all_rays, ray_settings, ray_i);
+        }
+    }
+}
+
+
+void generateRaysFromDirections(std::vector<Ray> &all_rays, glm::vec3 startPoint, RaySettings &ray_settings,
+                                std::vector<StartingDirection> &directions, int seed, TraceReception *reception) {
     int total_rays_done = 0;
     int* ptotal_rays_done = &total_rays_done;
-    for (int i = 0; i < NUM_THREADS; i++) {
-        GenerateDirections generateDirections{i};
-        std::thread t(castRayIteration, i, std::ref(all_rays), std::ref(startPoint), std::ref(directions), std::ref(ray_settings), block, &generateDirections, ptotal_rays_done);
-        threads.push_back(std::move(t));
+
+    // the fused reception is gathered level by level, so it always takes the wavefront pass
+    if (WAVEFRONT_TRACING || reception != nullptr) {
+        traceWavefront(all_rays, startPoint, directions, ray_settings, seed, reception);
+        return;
     }
 
     std::cout << "\rCasting rays: ";
     std::cout << *ptotal_rays_done << "/" << ray_settings.amount_of_rays;
 
-    for (auto& th : threads) {
-        th.join();
-    }
+    threadPool().parallelFor(0, ray_settings.amount_of_rays, RAY_CHUNK_SIZE, [&](int worker, int s, int e) {
+        castRayIteration(s, e, all_rays, startPoint, directions, ray_settings, seed, ptotal_rays_done);
+    });
     std::cout << std::endl;
 }
 
 
 
+Ray createFirstRay(glm::vec3 &starting_point, StartingDirection &startingDirection, int rayIndex, int seed) {
+    Energy oneEnergy OneEnergyTemplate;
+    return Ray{starting_point, startingDirection.d, startingDirection.initNums, rayIndex, oneEnergy, seed};
+}
+
 void castRay(std::vector<Ray> &all_rays, glm::vec3 &starting_point, StartingDirection &startingDirection,
-             RaySettings &ray_settings, int rayIndex, GenerateDirections *generateDirection) {
+             RaySettings &ray_settings, int rayIndex, int seed) {
 
+    Ray newRay = createFirstRay(starting_point, startingDirection, rayIndex, seed);
+    detectHit(newRay, ray_settings);
+    all_rays.at(rayIndex) = newRay;
 
+    castReflections(all_rays, ray_settings, rayIndex);
+}
 
-    for (int hit_level = 0; hit_level < ray_settings.max_hit_level; hit_level++) {
+void castReflections(std::vector<Ray> &all_rays, RaySettings &ray_settings, int rayIndex) {
+
+    for (int hit_level = 1; hit_level < ray_settings.max_hit_level; hit_level++) {
         int index = rayIndex + ray_settings.amount_of_rays * hit_level;
 
-        if (hit_level == 0) {
-            Energy oneEnergy OneEnergyTemplate;
-            Ray newRay{starting_point, startingDirection.d, startingDirection.initNums, rayIndex, oneEnergy, generateDirection};
-            detectHit(newRay, ray_settings);
+        Ray &prevRay = all_rays.at(index - (ray_settings.amount_of_rays));
 
-            all_rays.at(index) = newRay;
-        } else {
-            Ray &prevRay = all_rays.at(index - (ray_settings.amount_of_rays));
+        if (!prevRay.hit) {
+            clearPath(all_rays, ray_settings, rayIndex, hit_level);
+            break;
+        }
 
-            if (!prevRay.hit) {
-                break;
-            }
+        std::optional<Ray> reflectedRay = traceReflection(prevRay, hit_level, ray_settings);
 
-            Ray reflectedRay = prevRay.getReflectionRay(hit_level);
-            reflectedRay.total_previous_t = prevRay.total_previous_t + prevRay.t;
+        if (!reflectedRay.has_value()) {
+            clearPath(all_rays, ray_settings, rayIndex, hit_level);
+            break;
+        }
 
-            detectHit(reflectedRay, ray_settings);
+        all_rays.at(index) = reflectedRay.value();
+    }
+}
 
-            reflectedRay.updateEnergyOfRayAfterHit(prevRay);
-            all_rays.at(index) = reflectedRay;
-        }
+void clearPath(std::vector<Ray> &all_rays, const RaySettings &ray_settings, int rayIndex, int hit_level) {
+    for (; hit_level < ray_settings.max_hit_level; hit_level++) {
+        all_rays[rayIndex + ray_settings.amount_of_rays * hit_level].ray_start_index = -1;
+    }
+}
+
+// philox stream of the roulette decisions, the reflection directions use stream 0
+const uint32_t ROULETTE_STREAM = 1;
+
+// Ends the path below ENERGY_FLOOR and plays Russian roulette below ROULETTE_THRESHOLD.
+// A survivor of the roulette carries its energy divided by its survival probability, so the expected energy is unchanged.
+bool survivesRoulette(Ray &ray, int hit_level) {
+    float average = ray.current_energy.get_average();
 
+    if (average < global_config->ENERGY_FLOOR) {
+        return false;
     }
+
+    if (average >= global_config->ROULETTE_THRESHOLD) {
+        return true;
+    }
+
+    float survival = average / global_config->ROULETTE_THRESHOLD;
+    Philox random {(uint32_t) ray.seed, (uint32_t) ray.ray_start_index, (uint32_t) hit_level, ROULETTE_STREAM};
+
+    if (random.uniform() >= survival) {
+        return false;
+    }
+
+    ray.current_energy.multiply(1.0f / survival);
+    return true;
+}
+
+std::optional<Ray> createReflection(Ray &prevRay, int hit_level) {
+    Ray reflectedRay = prevRay.getReflectionRay(hit_level);
+    reflectedRay.total_previous_t = prevRay.total_previous_t + prevRay.t;
+    reflectedRay.updateEnergyOfRayAfterHit(prevRay);
+
+    // decided before tracing, a dead path costs nothing
+    if (!survivesRoulette(reflectedRay, hit_level)) {
+        return std::nullopt;
+    }
+
+    return reflectedRay;
+}
+
+std::optional<Ray> traceReflection(Ray &prevRay, int hit_level, const RaySettings &ray_settings) {
+    std::optional<Ray> reflectedRay = createReflection(prevRay, hit_level);
+
+    if (reflectedRay.has_value()) {
+        detectHit(reflectedRay.value(), ray_settings);
+    }
+
+    return reflectedRay;
 }
 
 std::ostream &operator<<(std::ostream &s, const Ray &ray) {
@@ -125,7 +217,8 @@ Ray Ray::getReflectionRay(int hit_level) {
         average_scattering = 0.0f;
     }
 
-    glm::vec3 randomUnitVector = generateDirections->getRandomDirection();
+    Philox random {(uint32_t) seed, (uint32_t) ray_start_index, (uint32_t) hit_level};
+    glm::vec3 randomUnitVector = getDirectionFrom2D(sample2D((uint32_t) seed, (uint32_t) ray_start_index, (uint32_t) hit_level, random));
     glm::vec3 reflectionVector = glm::reflect(direction, normal);
 
     reflectionVector = randomUnitVector * average_scattering + reflectionVector * (1 - average_scattering);
@@ -6,9 +6,14 @@
 #include <boost/optional.hpp>
 #include "Energy.h"
 #include "directionGenerator.h"
+#include "Bvh.h"
+#include "TriangleStore.h"
+#include "Walls.h"
 
 
 #pragma once
+struct TraceReception;
+
 struct HitInfo {
     glm::vec3 hitNormal;
     glm::vec3 hitPoint;
@@ -21,6 +26,10 @@ struct RaySettings {
     int max_hit_level;
     std::vector<Mesh> meshes;
     std::vector<glm::vec3> sourceLocations;
+    Bvh bvh;
+    TriangleStore triangles;
+    // mirrors of the image sources, empty unless initialize_walls ran
+    std::vector<Wall> walls;
 
     void initialize_source_locations(std::vector<Mesh> &sourcePlanes);
 
@@ -42,11 +51,13 @@ class Ray {
     bool hit {false};
     bool received {false};
     bool received_chain {false};
-    int hit_level;
-    int ray_start_index;
+    // -1 until the ray is traced
+    int hit_level = -1;
+    int ray_start_index = -1;
     Energy current_energy;
     float probability_ray_chosen = 1.0f;
-    GenerateDirections* generateDirections;
+    // seed of the iteration, keys the random stream of every bounce together with ray_start_index
+    int seed = 0;
 
     // diffuse and check ray creation
     Ray(glm::vec3 starting_point, glm::vec3 direction) {
@@ -57,14 +68,14 @@ class Ray {
     }
 
     // hit level zero ray creation
-    Ray(glm::vec3 starting_point, glm::vec3 direction, InitNums &initNums, int ray_start_index, Energy current_energy, GenerateDirections *generator) {
+    Ray(glm::vec3 starting_point, glm::vec3 direction, InitNums &initNums, int ray_start_index, Energy current_energy, int seed) {
         this->origin = starting_point;
         this->direction = direction;
         this->initNums = {initNums};
         this->hit_level = 0;
         this->ray_start_index = ray_start_index;
         this->current_energy = {current_energy};
-        this->generateDirections = generator;
+        this->seed = seed;
     }
 
     // reflection ray copy
@@ -77,7 +88,7 @@ class Ray {
         this->ray_start_index = templateRay->ray_start_index;
         this->current_energy = {templateRay->current_energy};
         this->probability_ray_chosen = templateRay->probability_ray_chosen;
-        this->generateDirections = templateRay->generateDirections;
+        this->seed = templateRay->seed;
 
     }
 
@@ -89,7 +100,23 @@ class Ray {
 std::ostream& operator<<(std::ostream &s, const Ray &ray);
 
 void initialize_meshes(RaySettings &ray_settings);
-void generateRays(std::vector<Ray> &all_rays, glm::vec3 startPoint, RaySettings &ray_settings, int seed);
-void generateRaysFromDirections(std::vector<Ray> &all_rays, glm::vec3 startPoint, RaySettings &ray_settings, std::vector<StartingDirection> &directions);
+// once per scene, every image source tree mirrors in the same walls
+void initialize_walls(RaySettings &ray_settings);
+void generateRays(std::vector<Ray> &all_rays, glm::vec3 startPoint, RaySettings &ray_settings, int seed, TraceReception *reception = nullptr);
+// with a reception every segment is also received right after it is traced, see TraceReception
+void generateRaysFromDirections(std::vector<Ray> &all_rays, glm::vec3 startPoint, RaySettings &ray_settings, std::vector<StartingDirection> &directions, int seed,
+                                TraceReception *reception = nullptr);
 void castRay(std::vector<Ray> &all_rays, glm::vec3 &starting_point, StartingDirection &startingDirection,
-             RaySettings &ray_settings, int rayIndex, GenerateDirections *generateDirection);
+             RaySettings &ray_settings, int rayIndex, int seed);
+void castRayPackets(std::vector<Ray> &all_rays, glm::vec3 &startPoint, std::vector<StartingDirection> &directions,
+                    RaySettings &ray_settings, int s, int e, int seed, int* ptotal_rays_done);
+Ray createFirstRay(glm::vec3 &starting_point, StartingDirection &startingDirection, int rayIndex, int seed);
+// traces hit level 1 and up, the hit level 0 ray must already be stored at rayIndex
+void castReflections(std::vector<Ray> &all_rays, RaySettings &ray_settings, int rayIndex);
+// marks the slots of an ended path from hit_level on as unused, all_rays is reused across passes and would still
+// hold the rays an earlier pass traced there
+void clearPath(std::vector<Ray> &all_rays, const RaySettings &ray_settings, int rayIndex, int hit_level);
+// reflects prevRay off its hit without tracing it, nothing when the roulette or the energy floor ends the path
+std::optional<Ray> createReflection(Ray &prevRay, int hit_level);
+// reflects prevRay off its hit and traces the reflection, nothing when the roulette or the energy floor ends the path
+std::optional<Ray> traceReflection(Ray &prevRay, int hit_level, const RaySettings &ray_settings);
@@ -4,34 +4,57 @@
 #include "helpers/printHelper.h"
 #include <boost/optional.hpp>
 #include <settings.h>
+#include <algorithm>
 
 
-bool pointInTriangle(const VertexTriangle &triangle, const glm::vec3 &hitPoint);
+std::optional<float> intersectWithSphere(const Sphere &sphere, const Ray &ray) {
+    float dx = ray.direction.x;
+    float dy = ray.direction.y;
+    float dz = ray.direction.z;
 
-float intersectWithPlane(const Ray &ray, const VertexTriangle &triangle) {
+    float ox = ray.origin.x - sphere.center.x;
+    float oy = ray.origin.y - sphere.center.y;
+    float oz = ray.origin.z - sphere.center.z;
 
+    float r = sphere.radius;
 
-    float t = (triangle.planeD - glm::dot(ray.origin, triangle.planeNormal)) / glm::dot(ray.direction, triangle.planeNormal);
-    if (std::abs(t) < EPSILON) return infT; /// mega improvement
-    
-    return t;
-}
+    float A = dx * dx + dy * dy + dz * dz;
+    float B = 2 * (dx * ox + dy * oy + dz * oz);
+    float C = ox * ox + oy * oy + oz * oz - r * r;
 
-bool intersectWithTriangle(Ray &ray, const VertexTriangle &triangle, AudioReflection *audioReflection) {
+    float discriminant = B * B - 4 * A * C;
 
-    float t = intersectWithPlane(ray, triangle);
-    
-    if (t >= ray.t || t < 0) {
-        return false;
+    if (discriminant < EPSILON)
+        return std::nullopt;
+
+
+    float t0 = (-B - std::sqrt(discriminant)) / 2 * A;
+    float t1 = (-B + std::sqrt(discriminant)) / 2 * A;
+
+    float average_t = (t0 + t1) / 2.0f;
+
+    if (average_t < 0)
+        return std::nullopt;
+
+    if (ray.t < average_t) {
+        return std::nullopt;
     }
 
-    glm::vec3 hitPoint = ray.origin + ray.direction * t;
+    return average_t;
+}
 
-    if (!pointInTriangle(triangle, hitPoint)) {
+bool intersectWithPacket(Ray &ray, const RaySettings &ray_settings, int packet_index) {
+    const TrianglePacket &packet = ray_settings.triangles.packets[packet_index];
+
+    float t = ray.t;
+    int lane = intersectTrianglePacket(packet, ray.origin, ray.direction, t);
+
+    if (lane < 0) {
         return false;
     }
 
-    glm::vec3 normal = triangle.planeNormal;
+    glm::vec3 hitPoint = ray.origin + ray.direction * t;
+    glm::vec3 normal = packet.normal(lane);
 
     if (glm::dot((ray.origin - hitPoint), normal) <= 0) {
         normal = -normal;
@@ -41,71 +64,142 @@ bool intersectWithTriangle(Ray &ray, const VertexTriangle &triangle, AudioReflec
     ray.hit = true;
     ray.hitInfo = HitInfo{normal, hitPoint};
     ray.hitInfo.incomingT = ray.total_previous_t;
-    ray.hitInfo.hitAudioReflection = audioReflection;
+    ray.hitInfo.hitAudioReflection = ray_settings.meshes[ray_settings.triangles.material(packet_index, lane)].audioReflection;
 
     return true;
 }
 
-bool pointInTriangle(const VertexTriangle &triangle, const glm::vec3 &hitPoint) {
+bool intersectWithAabb(const Aabb &aabb, const glm::vec3 &origin, const glm::vec3 &inverseDirection, float max_t, float &entry_t) {
+    // slab test
+    glm::vec3 t0 = (aabb.min - origin) * inverseDirection;
+    glm::vec3 t1 = (aabb.max - origin) * inverseDirection;
+    glm::vec3 t_small = glm::min(t0, t1);
+    glm::vec3 t_big = glm::max(t0, t1);
 
-    glm::vec3 c0 = glm::cross(hitPoint - triangle.vertex_2.p, triangle.vertex_1.p - triangle.vertex_2.p);
-    glm::vec3 c1 = glm::cross(hitPoint - triangle.vertex_0.p, triangle.vertex_2.p - triangle.vertex_0.p);
-    glm::vec3 c2 = glm::cross(hitPoint - triangle.vertex_1.p, triangle.vertex_0.p - triangle.vertex_1.p);
+    float t_enter = std::max(std::max(t_small.x, t_small.y), t_small.z);
+    float t_exit = std::min(std::min(t_big.x, t_big.y), t_big.z);
 
+    entry_t = t_enter;
+    return t_exit >= std::max(t_enter, 0.0f) && t_enter < max_t;
+}
 
-    /// If the normal and the cross product point in the same direction, then the sign is positive
-    /// Otherwise it is negative
-    float sign0 = glm::dot(c0, triangle.vertex_0.n);
-    float sign1 = glm::dot(c1, triangle.vertex_0.n);
-    float sign2 = glm::dot(c2, triangle.vertex_0.n);
+struct BvhStackEntry {
+    int node;
+    float entry_t;
+};
 
+void detectHitBvh(Ray &ray, const RaySettings &ray_settings) {
+    const Bvh &bvh = ray_settings.bvh;
+    glm::vec3 inverseDirection = 1.0f / ray.direction;
 
-    if (sign0 >= 0 && sign1 >= 0 && sign2 >= 0)
-        return true;
-    return false;
-}
+    BvhStackEntry stack[BVH_STACK_SIZE];
+    int stack_size = 0;
 
-std::optional<float> intersectWithSphere(Sphere &sphere, Ray &ray) {
-    float dx = ray.direction.x;
-    float dy = ray.direction.y;
-    float dz = ray.direction.z;
+    float root_t;
+    if (!intersectWithAabb(bvh.nodes.at(0).bounds, ray.origin, inverseDirection, ray.t, root_t)) {
+        return;
+    }
+    stack[stack_size++] = {0, root_t};
 
-    float ox = ray.origin.x - sphere.center.x;
-    float oy = ray.origin.y - sphere.center.y;
-    float oz = ray.origin.z - sphere.center.z;
+    while (stack_size > 0) {
+        BvhStackEntry entry = stack[--stack_size];
 
-    float r = sphere.radius;
+        // a closer hit has been found since this node was pushed
+        if (entry.entry_t >= ray.t) {
+            continue;
+        }
 
-    float A = dx * dx + dy * dy + dz * dz;
-    float B = 2 * (dx * ox + dy * oy + dz * oz);
-    float C = ox * ox + oy * oy + oz * oz - r * r;
+        const BvhNode &node = bvh.nodes[entry.node];
 
-    float discriminant = B * B - 4 * A * C;
+        if (node.isLeaf()) {
+            for (int packet = node.first; packet < node.first + node.packetCount(); packet++) {
+                intersectWithPacket(ray, ray_settings, packet);
+            }
+            continue;
+        }
 
-    if (discriminant < EPSILON)
-        return std::nullopt;
+        float left_t;
+        float right_t;
+        bool hit_left = intersectWithAabb(bvh.nodes[node.first].bounds, ray.origin, inverseDirection, ray.t, left_t);
+        bool hit_right = intersectWithAabb(bvh.nodes[node.first + 1].bounds, ray.origin, inverseDirection, ray.t, right_t);
+
+        // push the farthest child first so the nearest one is visited first
+        if (hit_left && hit_right) {
+            if (left_t < right_t) {
+                stack[stack_size++] = {node.first + 1, right_t};
+                stack[stack_size++] = {node.first, left_t};
+            } else {
+                stack[stack_size++] = {node.first, left_t};
+                stack[stack_size++] = {node.first + 1, right_t};
+            }
+        } else if (hit_left) {
+            stack[stack_size++] = {node.first, left_t};
+        } else if (hit_right) {
+            stack[stack_size++] = {node.first + 1, right_t};
+        }
+    }
+}
 
+void detectHit(Ray &ray, const RaySettings &ray_settings) {
 
-    float t0 = (-B - std::sqrt(discriminant)) / 2 * A;
-    float t1 = (-B + std::sqrt(discriminant)) / 2 * A;
+    if (USE_BVH && !ray_settings.bvh.empty()) {
+        detectHitBvh(ray, ray_settings);
+        return;
+    }
 
-    float average_t = (t0 + t1) / 2.0f;
+    for (int packet = 0; packet < ray_settings.triangles.packets.size(); packet++) {
+        intersectWithPacket(ray, ray_settings, packet);
+    }
+}
 
-    if (average_t < 0)
-        return std::nullopt;
+bool isOccludedBvh(const glm::vec3 &origin, const glm::vec3 &direction, float max_t, const RaySettings &ray_settings) {
+    const Bvh &bvh = ray_settings.bvh;
+    const TriangleStore &triangles = ray_settings.triangles;
+    glm::vec3 inverseDirection = 1.0f / direction;
 
-    if (ray.t < average_t) {
-        return std::nullopt;
+    int stack[BVH_STACK_SIZE];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+
+    // no ordering needed, any blocker ends the query
+    while (stack_size > 0) {
+        const BvhNode &node = bvh.nodes[stack[--stack_size]];
+
+        float entry_t;
+        if (!intersectWithAabb(node.bounds, origin, inverseDirection, max_t, entry_t)) {
+            continue;
+        }
+
+        if (!node.isLeaf()) {
+            stack[stack_size++] = node.first + 1;
+            stack[stack_size++] = node.first;
+            continue;
+        }
+
+        for (int packet = node.first; packet < node.first + node.packetCount(); packet++) {
+            if (occludedByTrianglePacket(triangles.packets[packet], origin, direction, max_t)) {
+                return true;
+            }
+        }
     }
 
-    return average_t;
+    return false;
 }
 
-void detectHit(Ray &ray, const RaySettings &ray_settings) {
+bool isOccluded(const glm::vec3 &origin, const glm::vec3 &target, const RaySettings &ray_settings) {
+    glm::vec3 to_target = target - origin;
+    float distance = glm::length(to_target);
+    glm::vec3 direction = to_target / distance;
+
+    if (USE_BVH && !ray_settings.bvh.empty()) {
+        return isOccludedBvh(origin, direction, distance, ray_settings);
+    }
 
-    for (const Mesh &mesh : ray_settings.meshes) {
-        for (const VertexTriangle &triangle : mesh.vertexTriangles) {
-            intersectWithTriangle(ray, triangle, mesh.audioReflection);
+    for (const TrianglePacket &packet : ray_settings.triangles.packets) {
+        if (occludedByTrianglePacket(packet, origin, direction, distance)) {
+            return true;
         }
     }
+
+    return false;
 }
@@ -3,6 +3,11 @@
 #include "Ray.h"
 
 void detectHit(Ray &ray, const RaySettings &ray_settings);
-std::optional<float> intersectWithSphere(Sphere &sphere, Ray &ray);
+// shadow ray query, true when any triangle lies between origin and target
+bool isOccluded(const glm::vec3 &origin, const glm::vec3 &target, const RaySettings &ray_settings);
+std::optional<float> intersectWithSphere(const Sphere &sphere, const Ray &ray);
+
+bool intersectWithAabb(const Aabb &aabb, const glm::vec3 &origin, const glm::vec3 &inverseDirection, float max_t, float &entry_t);
+bool intersectWithPacket(Ray &ray, const RaySettings &ray_settings, int packet_index);
 
 
@@ -0,0 +1,153 @@
+#include "SphereGrid.h"
+#include "RayTracing.h"
+#include <settings.h>
+#include <algorithm>
+#include <cmath>
+
+
+int SphereGrid::cellIndex(const glm::ivec3 &cell) const {
+    return (cell.z * resolution.y + cell.y) * resolution.x + cell.x;
+}
+
+glm::ivec3 SphereGrid::cellOf(const glm::vec3 &point) const {
+    glm::ivec3 cell;
+
+    for (int axis = 0; axis < 3; axis++) {
+        int index = (int) std::floor((point[axis] - bounds.min[axis]) / cell_size);
+        cell[axis] = std::min(std::max(index, 0), resolution[axis] - 1);
+    }
+
+    return cell;
+}
+
+void SphereGrid::build(const std::vector<glm::vec3> &centers, float radius) {
+    this->centers = centers;
+    this->radius = radius;
+
+    glm::vec3 reach {radius, radius, radius};
+
+    bounds = {};
+    for (const glm::vec3 &center : centers) {
+        bounds.grow(center - reach);
+        bounds.grow(center + reach);
+    }
+
+    glm::vec3 extent = bounds.max - bounds.min;
+
+    // a sphere covers at most two cells per axis, unless the grid would get too large
+    cell_size = 2 * radius;
+    while ((double) std::ceil(extent.x / cell_size) * std::ceil(extent.y / cell_size) * std::ceil(extent.z / cell_size) > SPHERE_GRID_MAX_CELLS) {
+        cell_size *= 2;
+    }
+
+    for (int axis = 0; axis < 3; axis++) {
+        resolution[axis] = std::max((int) std::ceil(extent[axis] / cell_size), 1);
+    }
+    int cells = resolution.x * resolution.y * resolution.z;
+
+    // counting sort of the spheres over the cells they overlap
+    std::vector<std::pair<int, int>> entries;
+    for (int sphere_i = 0; sphere_i < centers.size(); sphere_i++) {
+        glm::ivec3 low = cellOf(centers[sphere_i] - reach);
+        glm::ivec3 high = cellOf(centers[sphere_i] + reach);
+
+        for (int z = low.z; z <= high.z; z++) {
+            for (int y = low.y; y <= high.y; y++) {
+                for (int x = low.x; x <= high.x; x++) {
+                    entries.emplace_back(cellIndex({x, y, z}), sphere_i);
+                }
+            }
+        }
+    }
+
+    cell_start.assign(cells + 1, 0);
+    for (auto &entry : entries) {
+        cell_start[entry.first + 1]++;
+    }
+    for (int cell = 0; cell < cells; cell++) {
+        cell_start[cell + 1] += cell_start[cell];
+    }
+
+    cell_spheres.resize(entries.size());
+    std::vector<int> filled(cell_start.begin(), cell_start.end() - 1);
+    for (auto &entry : entries) {
+        cell_spheres[filled[entry.first]++] = entry.second;
+    }
+}
+
+void SphereGrid::findHits(const Ray &ray, std::vector<int> &hits) const {
+    hits.clear();
+
+    if (centers.empty()) {
+        return;
+    }
+
+    // the part of the segment inside the grid
+    float t_enter = 0;
+    float t_exit = ray.t;
+    for (int axis = 0; axis < 3; axis++) {
+        if (ray.direction[axis] == 0) {
+            if (ray.origin[axis] < bounds.min[axis] || ray.origin[axis] > bounds.max[axis]) {
+                return;
+            }
+            continue;
+        }
+
+        float t0 = (bounds.min[axis] - ray.origin[axis]) / ray.direction[axis];
+        float t1 = (bounds.max[axis] - ray.origin[axis]) / ray.direction[axis];
+        t_enter = std::max(t_enter, std::min(t0, t1));
+        t_exit = std::min(t_exit, std::max(t0, t1));
+    }
+
+    if (t_enter > t_exit) {
+        return;
+    }
+
+    // 3D digital differential analyzer over the cells from t_enter to t_exit
+    glm::vec3 start = ray.origin + t_enter * ray.direction;
+    glm::ivec3 cell = cellOf(start);
+    glm::ivec3 step;
+    glm::vec3 t_next;
+    glm::vec3 t_delta;
+
+    for (int axis = 0; axis < 3; axis++) {
+        if (ray.direction[axis] == 0) {
+            step[axis] = 0;
+            t_next[axis] = infT;
+            t_delta[axis] = infT;
+            continue;
+        }
+
+        step[axis] = ray.direction[axis] > 0 ? 1 : -1;
+        float boundary = bounds.min[axis] + (cell[axis] + (step[axis] > 0 ? 1 : 0)) * cell_size;
+        t_next[axis] = (boundary - ray.origin[axis]) / ray.direction[axis];
+        t_delta[axis] = cell_size / std::abs(ray.direction[axis]);
+    }
+
+    while (true) {
+        int index = cellIndex(cell);
+        for (int entry = cell_start[index]; entry < cell_start[index + 1]; entry++) {
+            int sphere_i = cell_spheres[entry];
+
+            if (intersectWithSphere(sphere(sphere_i), ray).has_value()) {
+                hits.push_back(sphere_i);
+            }
+        }
+
+        int axis = t_next.x < t_next.y ? (t_next.x < t_next.z ? 0 : 2) : (t_next.y < t_next.z ? 1 : 2);
+        if (t_next[axis] > t_exit) {
+            break;
+        }
+
+        cell[axis] += step[axis];
+        if (cell[axis] < 0 || cell[axis] >= resolution[axis]) {
+            break;
+        }
+
+        t_next[axis] += t_delta[axis];
+    }
+
+    // a sphere overlapping several crossed cells is found once per cell
+    std::sort(hits.begin(), hits.end());
+    hits.erase(std::unique(hits.begin(), hits.end()), hits.end());
+}
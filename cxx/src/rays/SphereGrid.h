@@ -0,0 +1,32 @@
+#pragma once
+#include <vector>
+#include <glm/vec3.hpp>
+#include "Ray.h"
+
+
+// Uniform grid over spheres of one radius, so a ray segment only tests the spheres of the cells it crosses.
+struct SphereGrid {
+    std::vector<glm::vec3> centers;
+    float radius = 0;
+
+    Aabb bounds;
+    float cell_size = 0;
+    glm::ivec3 resolution {0};
+    // the spheres of cell c are cell_spheres[cell_start[c], cell_start[c + 1])
+    std::vector<int> cell_start;
+    std::vector<int> cell_spheres;
+
+    void build(const std::vector<glm::vec3> &centers, float radius);
+
+    Sphere sphere(int index) const {
+        return {centers.at(index), radius};
+    }
+
+    // the spheres the segment of ray up to ray.t passes through, in increasing order
+    void findHits(const Ray &ray, std::vector<int> &hits) const;
+
+private:
+    int cellIndex(const glm::ivec3 &cell) const;
+    // the cell of point, clamped to the grid
+    glm::ivec3 cellOf(const glm::vec3 &point) const;
+};
@@ -0,0 +1,128 @@
+#include "TabulatedProposal.h"
+#include <settings.h>
+#include <algorithm>
+#include <numeric>
+#include <stack>
+
+
+struct ProposalBuildTask {
+    int node;
+    double x;
+    double y;
+    double width;
+    double height;
+    int start;
+    int end;
+    int depth;
+};
+
+void TabulatedProposal::fit(const std::vector<InitNums> &hits) {
+    nodes.clear();
+    cells.clear();
+
+    int n = (int) hits.size();
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+
+    nodes.push_back({-1, -1});
+    std::stack<ProposalBuildTask> tasks;
+    tasks.push({0, 0.0, 0.0, 1.0, 1.0, 0, n, 0});
+
+    while (!tasks.empty()) {
+        ProposalBuildTask task = tasks.top();
+        tasks.pop();
+
+        if (task.end - task.start <= TABULATED_MAX_CELL_HITS || task.depth >= TABULATED_MAX_DEPTH) {
+            double area = task.width * task.height;
+            nodes.at(task.node).cell = (int) cells.size();
+            cells.push_back({task.x, task.y, task.width, task.height, (task.end - task.start + TABULATED_PSEUDO_HITS * area) / (n + TABULATED_PSEUDO_HITS)});
+            continue;
+        }
+
+        double half_width = task.width / 2;
+        double half_height = task.height / 2;
+        double split_x = task.x + half_width;
+        double split_y = task.y + half_height;
+
+        auto begin = order.begin() + task.start;
+        auto end = order.begin() + task.end;
+        auto below_y = [&](int hit) { return hits[hit].projectedCoords.y < split_y; };
+        auto mid_x = std::partition(begin, end, [&](int hit) { return hits[hit].projectedCoords.x < split_x; });
+        auto mid_left = std::partition(begin, mid_x, below_y);
+        auto mid_right = std::partition(mid_x, end, below_y);
+
+        // children ordered by (x >= split_x) * 2 + (y >= split_y), the same index pdf() descends with
+        int children = (int) nodes.size();
+        nodes.at(task.node).children = children;
+        for (int i = 0; i < 4; i++) {
+            nodes.push_back({-1, -1});
+        }
+
+        int bounds[5] = {task.start, (int) (mid_left - order.begin()), (int) (mid_x - order.begin()), (int) (mid_right - order.begin()), task.end};
+        for (int quadrant = 0; quadrant < 4; quadrant++) {
+            tasks.push({children + quadrant,
+                        task.x + (quadrant / 2) * half_width, task.y + (quadrant % 2) * half_height, half_width, half_height,
+                        bounds[quadrant], bounds[quadrant + 1], task.depth + 1});
+        }
+    }
+
+    // Vose's alias method
+    int k_count = (int) cells.size();
+    alias_probability.assign(k_count, 1.0);
+    alias.resize(k_count);
+    std::iota(alias.begin(), alias.end(), 0);
+
+    std::vector<double> scaled(k_count);
+    std::vector<int> small;
+    std::vector<int> large;
+    for (int i = 0; i < k_count; i++) {
+        scaled[i] = cells[i].mass * k_count;
+        (scaled[i] < 1.0 ? small : large).push_back(i);
+    }
+
+    while (!small.empty() && !large.empty()) {
+        int less = small.back();
+        small.pop_back();
+        int more = large.back();
+
+        alias_probability[less] = scaled[less];
+        alias[less] = more;
+
+        scaled[more] -= 1.0 - scaled[less];
+        if (scaled[more] < 1.0) {
+            large.pop_back();
+            small.push_back(more);
+        }
+    }
+}
+
+double TabulatedProposal::pdf(double x, double y) const {
+    const ProposalNode *node = &nodes.front();
+    double split_x = 0.5;
+    double split_y = 0.5;
+    double half = 0.5;
+
+    while (node->children != -1) {
+        int quadrant = (x >= split_x) * 2 + (y >= split_y);
+        node = &nodes[node->children + quadrant];
+
+        half /= 2;
+        split_x += x >= split_x ? half : -half;
+        split_y += y >= split_y ? half : -half;
+    }
+
+    const ProposalCell &cell = cells[node->cell];
+    return cell.mass / (cell.width * cell.height);
+}
+
+ProjectedCoords TabulatedProposal::draw(Philox &random) const {
+    int k_count = (int) cells.size();
+
+    int column = std::min((int) (random.uniform() * k_count), k_count - 1);
+    const ProposalCell &cell = cells[random.uniform() < alias_probability[column] ? column : alias[column]];
+
+    double x = std::min(cell.x + random.uniform() * cell.width, std::nextafter(1.0, 0.0));
+    double y = std::min(cell.y + random.uniform() * cell.height, std::nextafter(1.0, 0.0));
+
+    return {x, y};
+}
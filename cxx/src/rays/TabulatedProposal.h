@@ -0,0 +1,43 @@
+#pragma once
+#include <vector>
+#include "directionGenerator.h"
+#include "philox.h"
+
+
+struct ProposalCell {
+    double x;
+    double y;
+    double width;
+    double height;
+    // probability of sampling this cell, the density inside it is mass / (width * height)
+    double mass;
+};
+
+struct ProposalNode {
+    // index of the first of four children, -1 for a leaf
+    int children;
+    // leaf: index into cells
+    int cell;
+};
+
+// Piecewise constant density over the projected coords. The hits are binned into a quadtree that splits every
+// cell with more than TABULATED_MAX_CELL_HITS hits, so fitting is a single pass over the hits.
+// Cells are drawn in O(1) with an alias table and the pdf of a sample is exact.
+struct TabulatedProposal {
+    std::vector<ProposalNode> nodes;
+    std::vector<ProposalCell> cells;
+
+    // Vose alias table over cells
+    std::vector<double> alias_probability;
+    std::vector<int> alias;
+
+    bool empty() const {
+        return cells.empty();
+    }
+
+    void fit(const std::vector<InitNums> &hits);
+
+    double pdf(double x, double y) const;
+
+    ProjectedCoords draw(Philox &random) const;
+};
@@ -0,0 +1,247 @@
+#include "TriangleIntersection.h"
+#include <glm/geometric.hpp>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// the AVX kernel is compiled for AVX in any x86 build and only called when the cpu supports it
+#if defined(__AVX__)
+#define AVX_KERNEL
+#define AVX_TARGET
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && defined(__GNUC__)
+#define AVX_KERNEL
+#define AVX_TARGET __attribute__((target("avx")))
+#endif
+
+
+void TrianglePacket::clear() {
+    for (int lane = 0; lane < TRIANGLE_PACKET_SIZE; lane++) {
+        set(lane, glm::vec3{0.0f}, glm::vec3{0.0f}, glm::vec3{0.0f});
+    }
+}
+
+void TrianglePacket::set(int lane, const glm::vec3 &vertex_0, const glm::vec3 &vertex_1, const glm::vec3 &vertex_2) {
+    glm::vec3 edge_1 = vertex_1 - vertex_0;
+    glm::vec3 edge_2 = vertex_2 - vertex_0;
+
+    v0x[lane] = vertex_0.x;
+    v0y[lane] = vertex_0.y;
+    v0z[lane] = vertex_0.z;
+    e1x[lane] = edge_1.x;
+    e1y[lane] = edge_1.y;
+    e1z[lane] = edge_1.z;
+    e2x[lane] = edge_2.x;
+    e2y[lane] = edge_2.y;
+    e2z[lane] = edge_2.z;
+}
+
+glm::vec3 TrianglePacket::normal(int lane) const {
+    glm::vec3 edge_1 {e1x[lane], e1y[lane], e1z[lane]};
+    glm::vec3 edge_2 {e2x[lane], e2y[lane], e2z[lane]};
+    return glm::normalize(glm::cross(edge_1, edge_2));
+}
+
+static int closestLane(int mask, const float *lane_t, float &t) {
+    int closest = -1;
+
+    while (mask != 0) {
+        int lane = __builtin_ctz(mask);
+        mask &= mask - 1;
+
+        if (lane_t[lane] < t) {
+            t = lane_t[lane];
+            closest = lane;
+        }
+    }
+
+    return closest;
+}
+
+// Every kernel below returns the mask of lanes hit within [EPSILON, t) and writes the t of every lane to lane_t.
+
+#if defined(AVX_KERNEL)
+
+AVX_TARGET static int packetHitMaskAvx(const TrianglePacket &packet, const glm::vec3 &origin, const glm::vec3 &direction, float t, float *lane_t) {
+    static_assert(TRIANGLE_PACKET_SIZE == 8, "AVX kernel intersects 8 triangles at once");
+
+    const __m256 dx = _mm256_set1_ps(direction.x);
+    const __m256 dy = _mm256_set1_ps(direction.y);
+    const __m256 dz = _mm256_set1_ps(direction.z);
+
+    const __m256 e1x = _mm256_load_ps(packet.e1x);
+    const __m256 e1y = _mm256_load_ps(packet.e1y);
+    const __m256 e1z = _mm256_load_ps(packet.e1z);
+    const __m256 e2x = _mm256_load_ps(packet.e2x);
+    const __m256 e2y = _mm256_load_ps(packet.e2y);
+    const __m256 e2z = _mm256_load_ps(packet.e2z);
+
+    // p = d x e2
+    const __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+    const __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+    const __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+
+    const __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+    const __m256 inverse_det = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+
+    // s = o - v0
+    const __m256 sx = _mm256_sub_ps(_mm256_set1_ps(origin.x), _mm256_load_ps(packet.v0x));
+    const __m256 sy = _mm256_sub_ps(_mm256_set1_ps(origin.y), _mm256_load_ps(packet.v0y));
+    const __m256 sz = _mm256_sub_ps(_mm256_set1_ps(origin.z), _mm256_load_ps(packet.v0z));
+
+    const __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz)), inverse_det);
+
+    // q = s x e1
+    const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+    const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+    const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+
+    const __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), inverse_det);
+    const __m256 hit_t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), inverse_det);
+
+    // NaN lanes (degenerate triangles) fail every ordered comparison
+    __m256 mask = _mm256_cmp_ps(det, _mm256_setzero_ps(), _CMP_NEQ_OQ);
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, _mm256_setzero_ps(), _CMP_GE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_GE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(u, v), _mm256_set1_ps(1.0f), _CMP_LE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(hit_t, _mm256_set1_ps(EPSILON), _CMP_GE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(hit_t, _mm256_set1_ps(t), _CMP_LT_OQ));
+
+    _mm256_store_ps(lane_t, hit_t);
+    return _mm256_movemask_ps(mask);
+}
+
+#endif
+
+#if defined(__AVX__)
+
+static int packetHitMask(const TrianglePacket &packet, const glm::vec3 &origin, const glm::vec3 &direction, float t, float *lane_t) {
+    return packetHitMaskAvx(packet, origin, direction, t, lane_t);
+}
+
+#elif defined(__SSE2__)
+
+// intersects the 4 lanes starting at offset, returns the hit mask of those lanes
+static int intersectHalfPacket(const TrianglePacket &packet, int offset, const glm::vec3 &origin, const glm::vec3 &direction, float t, float *lane_t) {
+    const __m128 dx = _mm_set1_ps(direction.x);
+    const __m128 dy = _mm_set1_ps(direction.y);
+    const __m128 dz = _mm_set1_ps(direction.z);
+
+    const __m128 e1x = _mm_load_ps(packet.e1x + offset);
+    const __m128 e1y = _mm_load_ps(packet.e1y + offset);
+    const __m128 e1z = _mm_load_ps(packet.e1z + offset);
+    const __m128 e2x = _mm_load_ps(packet.e2x + offset);
+    const __m128 e2y = _mm_load_ps(packet.e2y + offset);
+    const __m128 e2z = _mm_load_ps(packet.e2z + offset);
+
+    // p = d x e2
+    const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+
+    const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+    const __m128 inverse_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+    // s = o - v0
+    const __m128 sx = _mm_sub_ps(_mm_set1_ps(origin.x), _mm_load_ps(packet.v0x + offset));
+    const __m128 sy = _mm_sub_ps(_mm_set1_ps(origin.y), _mm_load_ps(packet.v0y + offset));
+    const __m128 sz = _mm_sub_ps(_mm_set1_ps(origin.z), _mm_load_ps(packet.v0z + offset));
+
+    const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverse_det);
+
+    // q = s x e1
+    const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+    const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+    const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+
+    const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverse_det);
+    const __m128 hit_t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverse_det);
+
+    // NaN lanes (degenerate triangles) fail every ordered comparison
+    __m128 mask = _mm_cmpneq_ps(det, _mm_setzero_ps());
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(u, _mm_setzero_ps()));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(v, _mm_setzero_ps()));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(hit_t, _mm_set1_ps(EPSILON)));
+    mask = _mm_and_ps(mask, _mm_cmplt_ps(hit_t, _mm_set1_ps(t)));
+
+    _mm_store_ps(lane_t + offset, hit_t);
+    return _mm_movemask_ps(mask) << offset;
+}
+
+static int packetHitMaskSse(const TrianglePacket &packet, const glm::vec3 &origin, const glm::vec3 &direction, float t, float *lane_t) {
+    static_assert(TRIANGLE_PACKET_SIZE == 8, "SSE kernel intersects 2 times 4 triangles");
+
+    return intersectHalfPacket(packet, 0, origin, direction, t, lane_t) | intersectHalfPacket(packet, 4, origin, direction, t, lane_t);
+}
+
+#if defined(AVX_KERNEL)
+static bool cpuSupportsAvx() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx");
+}
+
+static const bool use_avx = cpuSupportsAvx();
+#endif
+
+static int packetHitMask(const TrianglePacket &packet, const glm::vec3 &origin, const glm::vec3 &direction, float t, float *lane_t) {
+#if defined(AVX_KERNEL)
+    if (use_avx) {
+        return packetHitMaskAvx(packet, origin, direction, t, lane_t);
+    }
+#endif
+    return packetHitMaskSse(packet, origin, direction, t, lane_t);
+}
+
+#else
+
+static int packetHitMask(const TrianglePacket &packet, const glm::vec3 &origin, const glm::vec3 &direction, float t, float *lane_t) {
+    // scalar Möller–Trumbore, written lane-wise so the compiler can vectorize it
+    int hits = 0;
+
+    for (int lane = 0; lane < TRIANGLE_PACKET_SIZE; lane++) {
+        float px = direction.y * packet.e2z[lane] - direction.z * packet.e2y[lane];
+        float py = direction.z * packet.e2x[lane] - direction.x * packet.e2z[lane];
+        float pz = direction.x * packet.e2y[lane] - direction.y * packet.e2x[lane];
+
+        float det = packet.e1x[lane] * px + packet.e1y[lane] * py + packet.e1z[lane] * pz;
+        float inverse_det = 1.0f / det;
+
+        float sx = origin.x - packet.v0x[lane];
+        float sy = origin.y - packet.v0y[lane];
+        float sz = origin.z - packet.v0z[lane];
+
+        float u = (sx * px + sy * py + sz * pz) * inverse_det;
+
+        float qx = sy * packet.e1z[lane] - sz * packet.e1y[lane];
+        float qy = sz * packet.e1x[lane] - sx * packet.e1z[lane];
+        float qz = sx * packet.e1y[lane] - sy * packet.e1x[lane];
+
+        float v = (direction.x * qx + direction.y * qy + direction.z * qz) * inverse_det;
+        lane_t[lane] = (packet.e2x[lane] * qx + packet.e2y[lane] * qy + packet.e2z[lane] * qz) * inverse_det;
+
+        bool hit = det != 0.0f && u >= 0.0f && v >= 0.0f && u + v <= 1.0f && lane_t[lane] >= EPSILON && lane_t[lane] < t;
+        hits |= hit << lane;
+    }
+
+    return hits;
+}
+
+#endif
+
+int intersectTrianglePacket(const TrianglePacket &packet, const glm::vec3 &origin, const glm::vec3 &direction, float &t) {
+    alignas(32) float lane_t[TRIANGLE_PACKET_SIZE];
+    int hits = packetHitMask(packet, origin, direction, t, lane_t);
+
+    if (hits == 0) {
+        return -1;
+    }
+
+    return closestLane(hits, lane_t, t);
+}
+
+bool occludedByTrianglePacket(const TrianglePacket &packet, const glm::vec3 &origin, const glm::vec3 &direction, float max_t) {
+    alignas(32) float lane_t[TRIANGLE_PACKET_SIZE];
+    return packetHitMask(packet, origin, direction, max_t, lane_t) != 0;
+}
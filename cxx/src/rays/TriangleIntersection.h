@@ -0,0 +1,29 @@
+#pragma once
+#include <vector>
+#include <glm/vec3.hpp>
+#include <settings.h>
+
+
+// TRIANGLE_PACKET_SIZE triangles in structure-of-arrays layout, precomputed for Möller–Trumbore.
+// Unused lanes are degenerate (zero edges) and never report a hit.
+struct alignas(32) TrianglePacket {
+    float v0x[TRIANGLE_PACKET_SIZE];
+    float v0y[TRIANGLE_PACKET_SIZE];
+    float v0z[TRIANGLE_PACKET_SIZE];
+    float e1x[TRIANGLE_PACKET_SIZE];
+    float e1y[TRIANGLE_PACKET_SIZE];
+    float e1z[TRIANGLE_PACKET_SIZE];
+    float e2x[TRIANGLE_PACKET_SIZE];
+    float e2y[TRIANGLE_PACKET_SIZE];
+    float e2z[TRIANGLE_PACKET_SIZE];
+
+    void clear();
+    void set(int lane, const glm::vec3 &vertex_0, const glm::vec3 &vertex_1, const glm::vec3 &vertex_2);
+    glm::vec3 normal(int lane) const;
+};
+
+// Returns the lane of the closest triangle hit within [EPSILON, t) and lowers t to it, -1 when nothing is hit.
+int intersectTrianglePacket(const TrianglePacket &packet, const glm::vec3 &origin, const glm::vec3 &direction, float &t);
+
+// Any hit within [EPSILON, max_t), does not look for the closest triangle.
+bool occludedByTrianglePacket(const TrianglePacket &packet, const glm::vec3 &origin, const glm::vec3 &direction, float max_t);
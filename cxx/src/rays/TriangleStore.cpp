@@ -0,0 +1,71 @@
+#include "TriangleStore.h"
+#include <iostream>
+
+
+void TriangleStore::add(const SceneTriangle &triangle, int slot) {
+    int packet = slot / TRIANGLE_PACKET_SIZE;
+    int lane = slot % TRIANGLE_PACKET_SIZE;
+
+    if (lane == 0) {
+        packets.emplace_back();
+        packets.back().clear();
+        materials.resize(materials.size() + TRIANGLE_PACKET_SIZE, -1);
+    }
+
+    packets.at(packet).set(lane, triangle.vertex_0, triangle.vertex_1, triangle.vertex_2);
+    materials.at(slot) = triangle.material;
+}
+
+void TriangleStore::build(const std::vector<SceneTriangle> &triangles, Bvh &bvh) {
+    packets.clear();
+    materials.clear();
+
+    if (bvh.empty()) {
+        // brute force, pack every triangle in mesh order
+        packets.reserve((triangles.size() + TRIANGLE_PACKET_SIZE - 1) / TRIANGLE_PACKET_SIZE);
+        for (int i = 0; i < triangles.size(); i++) {
+            add(triangles.at(i), i);
+        }
+        return;
+    }
+
+    // every leaf starts at a new packet, so leafs can point to their packets instead of their primitives
+    for (BvhNode &node : bvh.nodes) {
+        if (!node.isLeaf()) {
+            continue;
+        }
+
+        int first_packet = (int) packets.size();
+        for (int i = 0; i < node.count; i++) {
+            add(triangles.at(bvh.primitives.at(node.first + i)), first_packet * TRIANGLE_PACKET_SIZE + i);
+        }
+        node.first = first_packet;
+    }
+
+    // leaf order now lives in the packets
+    bvh.primitives.clear();
+    bvh.primitives.shrink_to_fit();
+}
+
+size_t TriangleStore::bytes() const {
+    return packets.size() * sizeof(TrianglePacket) + materials.size() * sizeof(int);
+}
+
+std::vector<SceneTriangle> collectSceneTriangles(const std::vector<Mesh> &meshes) {
+    std::vector<SceneTriangle> triangles;
+
+    for (int mesh_i = 0; mesh_i < meshes.size(); mesh_i++) {
+        const Mesh &mesh = meshes.at(mesh_i);
+
+        for (Triangle triangle : mesh.triangles) {
+            triangles.push_back({
+                    mesh.vertices.at(triangle.x).p,
+                    mesh.vertices.at(triangle.y).p,
+                    mesh.vertices.at(triangle.z).p,
+                    mesh_i
+            });
+        }
+    }
+
+    return triangles;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <vector>
+#include <Mesh.h>
+#include "Bvh.h"
+#include "TriangleIntersection.h"
+
+
+// All triangles of the scene in one buffer of simd packets, ordered by bvh leaf when a bvh is used.
+// Only what intersection needs is stored: vertex 0 and two edges, plus the material of every lane.
+struct TriangleStore {
+    std::vector<TrianglePacket> packets;
+    // material index per lane (the mesh the triangle came from), -1 for padding
+    std::vector<int> materials;
+
+    // packs the triangles, bvh leafs are redirected from their primitives to their packets
+    void build(const std::vector<SceneTriangle> &triangles, Bvh &bvh);
+
+    int material(int packet, int lane) const {
+        return materials[packet * TRIANGLE_PACKET_SIZE + lane];
+    }
+
+    size_t bytes() const;
+
+private:
+    void add(const SceneTriangle &triangle, int slot);
+};
+
+std::vector<SceneTriangle> collectSceneTriangles(const std::vector<Mesh> &meshes);
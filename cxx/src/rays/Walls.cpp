@@ -0,0 +1,123 @@
+#include "Walls.h"
+#include <settings.h>
+#include <glm/geometric.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+
+
+float Wall::distance(const glm::vec3 &point) const {
+    return glm::dot(normal, point) - offset;
+}
+
+bool Wall::mayContain(const glm::vec3 &point) const {
+    for (int axis = 0; axis < 3; axis++) {
+        if (point[axis] < bounds.min[axis] - IMAGE_SOURCE_PLANE_TOLERANCE || point[axis] > bounds.max[axis] + IMAGE_SOURCE_PLANE_TOLERANCE) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// cell of a plane in (normal, offset) space
+typedef std::array<int64_t, 4> PlaneCell;
+
+struct PlaneCellHash {
+    size_t operator()(const PlaneCell &cell) const {
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (int64_t coordinate : cell) {
+            hash = (hash ^ (uint64_t) coordinate) * 0x100000001b3ULL;
+        }
+        return hash;
+    }
+};
+
+// the plane in units of the cell width along every axis
+static std::array<float, 4> planeCoordinates(const glm::vec3 &normal, float offset, float normal_cell, float offset_cell) {
+    return {normal.x / normal_cell, normal.y / normal_cell, normal.z / normal_cell, offset / offset_cell};
+}
+
+std::vector<Wall> collectWalls(const std::vector<SceneTriangle> &triangles) {
+    std::vector<Wall> walls;
+
+    // Coplanar normals differ by less than sqrt(2 * tolerance) per coordinate, as 1 - cos of their angle is below the
+    // tolerance. The offsets then differ by less than tolerance + sqrt(2 * tolerance) * the distance of the vertex from
+    // the origin. With cells twice that wide a wall the triangle can join lies in its own cell or in the neighbouring
+    // one on the side of the nearer cell border, along every axis.
+    float extent = 0;
+    for (const SceneTriangle &triangle : triangles) {
+        for (const glm::vec3 &vertex : {triangle.vertex_0, triangle.vertex_1, triangle.vertex_2}) {
+            extent = std::max(extent, glm::length(vertex));
+        }
+    }
+    float normal_cell = 2 * std::sqrt(2 * IMAGE_SOURCE_PLANE_TOLERANCE);
+    float offset_cell = 2 * IMAGE_SOURCE_PLANE_TOLERANCE + normal_cell * extent;
+
+    std::unordered_map<PlaneCell, std::vector<int>, PlaneCellHash> cells;
+
+    for (const SceneTriangle &triangle : triangles) {
+        glm::vec3 normal = glm::cross(triangle.vertex_1 - triangle.vertex_0, triangle.vertex_2 - triangle.vertex_0);
+        float length = glm::length(normal);
+
+        // degenerate triangles reflect nothing
+        if (length < EPSILON) {
+            continue;
+        }
+
+        normal /= length;
+        float offset = glm::dot(normal, triangle.vertex_0);
+
+        // the first wall of the plane, which may face either way
+        int wall_i = -1;
+        for (float sign : {1.0f, -1.0f}) {
+            std::array<float, 4> coordinates = planeCoordinates(sign * normal, sign * offset, normal_cell, offset_cell);
+
+            for (int corner = 0; corner < 16; corner++) {
+                PlaneCell cell;
+                for (int axis = 0; axis < 4; axis++) {
+                    float base = std::floor(coordinates[axis]);
+                    int towards = coordinates[axis] - base < 0.5f ? -1 : 1;
+                    cell[axis] = (int64_t) base + ((corner >> axis) & 1) * towards;
+                }
+
+                auto found = cells.find(cell);
+                if (found == cells.end()) {
+                    continue;
+                }
+
+                for (int candidate_i : found->second) {
+                    const Wall &candidate = walls[candidate_i];
+                    float alignment = glm::dot(candidate.normal, normal);
+                    bool coplanar = std::abs(std::abs(alignment) - 1) < IMAGE_SOURCE_PLANE_TOLERANCE &&
+                                    std::abs(candidate.distance(triangle.vertex_0)) < IMAGE_SOURCE_PLANE_TOLERANCE;
+
+                    if (coplanar && (wall_i == -1 || candidate_i < wall_i)) {
+                        wall_i = candidate_i;
+                    }
+                }
+            }
+        }
+
+        if (wall_i == -1) {
+            wall_i = (int) walls.size();
+            walls.push_back({normal, offset, {}, {}});
+
+            std::array<float, 4> coordinates = planeCoordinates(normal, offset, normal_cell, offset_cell);
+            PlaneCell cell;
+            for (int axis = 0; axis < 4; axis++) {
+                cell[axis] = (int64_t) std::floor(coordinates[axis]);
+            }
+            cells[cell].push_back(wall_i);
+        }
+
+        walls[wall_i].triangles.push_back(triangle);
+        for (const glm::vec3 &vertex : {triangle.vertex_0, triangle.vertex_1, triangle.vertex_2}) {
+            walls[wall_i].bounds.grow(vertex);
+        }
+    }
+
+    return walls;
+}
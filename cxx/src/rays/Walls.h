@@ -0,0 +1,23 @@
+#pragma once
+#include <vector>
+#include <glm/vec3.hpp>
+#include <Mesh.h>
+#include "Bvh.h"
+
+
+// coplanar triangles, a single mirror for the image sources whatever their materials
+struct Wall {
+    // the plane dot(normal, x) = offset
+    glm::vec3 normal;
+    float offset;
+    std::vector<SceneTriangle> triangles;
+    Aabb bounds;
+
+    float distance(const glm::vec3 &point) const;
+    // false when point is outside the bounds of the triangles, a cheap test before tracing towards it
+    bool mayContain(const glm::vec3 &point) const;
+};
+
+// Groups the triangles into walls by plane, so a reflection on a seam between materials is found once.
+// The walls are hashed by their plane, so a triangle is only compared with the walls of nearly its plane.
+std::vector<Wall> collectWalls(const std::vector<SceneTriangle> &triangles);
@@ -0,0 +1,278 @@
+#include "Wavefront.h"
+#include "RayTracing.h"
+#include "PacketTracing.h"
+#include <ThreadPool.h>
+#include <TraceReception.h>
+#include <algorithm>
+#include <cmath>
+
+
+// hit level 0 of the rays [s, e), in bundles of neighbouring directions when packet tracing
+static void traceFirstLevel(std::vector<Ray> &all_rays, glm::vec3 &startPoint, std::vector<StartingDirection> &directions,
+                            RaySettings &ray_settings, int s, int e, int seed, const TraceReception *reception, ReceptionChunk &chunk) {
+    if (!PACKET_TRACING) {
+        for (int ray_i = s; ray_i < e; ray_i++) {
+            Ray newRay = createFirstRay(startPoint, directions.at(ray_i), ray_i, seed);
+            detectHit(newRay, ray_settings);
+            if (reception != nullptr) {
+                reception->receive(newRay, ray_settings, chunk);
+            }
+            all_rays.at(ray_i) = newRay;
+        }
+
+        return;
+    }
+
+    std::vector<int> order = coherentDirectionOrder(directions, s, e);
+    Ray packet[RAY_PACKET_SIZE];
+
+    for (int packet_start = 0; packet_start < order.size(); packet_start += RAY_PACKET_SIZE) {
+        int count = std::min(RAY_PACKET_SIZE, (int) order.size() - packet_start);
+
+        for (int i = 0; i < count; i++) {
+            int ray_i = order.at(packet_start + i);
+            packet[i] = createFirstRay(startPoint, directions.at(ray_i), ray_i, seed);
+        }
+
+        detectHitPacket(packet, count, ray_settings);
+
+        for (int i = 0; i < count; i++) {
+            if (reception != nullptr) {
+                reception->receive(packet[i], ray_settings, chunk);
+            }
+            all_rays.at(order.at(packet_start + i)) = packet[i];
+        }
+    }
+}
+
+void compactLive(const std::vector<int> &live, const std::vector<char> &alive, std::vector<int> &compacted) {
+    int n = (int) live.size();
+    int chunks = (n + WAVEFRONT_CHUNK_SIZE - 1) / WAVEFRONT_CHUNK_SIZE;
+    std::vector<int> offsets(chunks + 1, 0);
+
+    // count the survivors of every chunk, then an exclusive scan over the chunks gives where each chunk writes
+    threadPool().parallelFor(0, n, WAVEFRONT_CHUNK_SIZE, [&](int worker, int s, int e) {
+        int count = 0;
+        for (int i = s; i < e; i++) {
+            count += alive[i];
+        }
+        offsets[s / WAVEFRONT_CHUNK_SIZE + 1] = count;
+    });
+
+    for (int chunk = 0; chunk < chunks; chunk++) {
+        offsets[chunk + 1] += offsets[chunk];
+    }
+
+    compacted.resize(offsets[chunks]);
+
+    threadPool().parallelFor(0, n, WAVEFRONT_CHUNK_SIZE, [&](int worker, int s, int e) {
+        int out = offsets[s / WAVEFRONT_CHUNK_SIZE];
+        for (int i = s; i < e; i++) {
+            if (alive[i]) {
+                compacted[out++] = live[i];
+            }
+        }
+    });
+}
+
+static uint64_t spreadBits3(uint32_t x) {
+    // insert two zeros between each of the lower 10 bits
+    uint64_t v = x & 0x3ff;
+    v = (v | (v << 16)) & 0x030000ffull;
+    v = (v | (v << 8)) & 0x0300f00full;
+    v = (v | (v << 4)) & 0x030c30c3ull;
+    v = (v | (v << 2)) & 0x09249249ull;
+    return v;
+}
+
+static uint64_t spreadBits2(uint32_t x) {
+    // insert a zero between each of the lower 11 bits
+    uint64_t v = x & 0x7ff;
+    v = (v | (v << 8)) & 0x00ff00ffull;
+    v = (v | (v << 4)) & 0x0f0f0f0full;
+    v = (v | (v << 2)) & 0x33333333ull;
+    v = (v | (v << 1)) & 0x55555555ull;
+    return v;
+}
+
+static uint32_t quantize(float x, uint32_t levels) {
+    return (uint32_t) (std::min(std::max(x, 0.0f), 1.0f) * (float) (levels - 1));
+}
+
+// z-curve over the origin within the scene bounds, 10 bits per axis, above a z-curve over the octahedral direction
+static uint64_t rayOrderKey(const Ray &ray, const Aabb &bounds) {
+    uint64_t origin = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = bounds.max[axis] - bounds.min[axis];
+        float x = extent > 0 ? (ray.origin[axis] - bounds.min[axis]) / extent : 0.0f;
+        origin |= spreadBits3(quantize(x, 1 << 10)) << axis;
+    }
+
+    // octahedral map of the direction onto the unit square
+    const glm::vec3 &d = ray.direction;
+    float norm = std::abs(d.x) + std::abs(d.y) + std::abs(d.z);
+    float u = d.x / norm;
+    float v = d.y / norm;
+    if (d.z < 0) {
+        float folded_u = (1 - std::abs(v)) * (u >= 0 ? 1.0f : -1.0f);
+        v = (1 - std::abs(u)) * (v >= 0 ? 1.0f : -1.0f);
+        u = folded_u;
+    }
+
+    uint64_t direction = spreadBits2(quantize((u + 1) / 2, 1 << 11)) | (spreadBits2(quantize((v + 1) / 2, 1 << 11)) << 1);
+
+    return (origin << 22) | direction;
+}
+
+// sorted runs of RAY_SORT_RUN keys on the pool, merged pairwise until one run is left
+static void parallelSort(std::vector<std::pair<uint64_t, int>> &keys) {
+    int n = (int) keys.size();
+
+    threadPool().parallelFor(0, n, RAY_SORT_RUN, [&](int worker, int s, int e) {
+        std::sort(keys.begin() + s, keys.begin() + e);
+    });
+
+    for (int width = RAY_SORT_RUN; width < n; width *= 2) {
+        int pairs = (n + 2 * width - 1) / (2 * width);
+
+        threadPool().parallelFor(0, pairs, 1, [&](int worker, int s, int e) {
+            for (int pair = s; pair < e; pair++) {
+                int begin = pair * 2 * width;
+                int middle = std::min(begin + width, n);
+                int end = std::min(begin + 2 * width, n);
+                std::inplace_merge(keys.begin() + begin, keys.begin() + middle, keys.begin() + end);
+            }
+        });
+    }
+}
+
+void traceWavefront(std::vector<Ray> &all_rays, glm::vec3 &startPoint, std::vector<StartingDirection> &directions,
+                    RaySettings &ray_settings, int seed, TraceReception *reception) {
+    int amount_of_rays = ray_settings.amount_of_rays;
+
+    if (reception != nullptr) {
+        reception->clear();
+        reception->beginLevel((amount_of_rays + RAY_CHUNK_SIZE - 1) / RAY_CHUNK_SIZE);
+    }
+
+    std::cout << "\rWavefront level 0: " << amount_of_rays << " rays" << std::flush;
+
+    threadPool().parallelFor(0, amount_of_rays, RAY_CHUNK_SIZE, [&](int worker, int s, int e) {
+        ReceptionChunk chunk;
+        traceFirstLevel(all_rays, startPoint, directions, ray_settings, s, e, seed, reception, chunk);
+
+        if (reception != nullptr) {
+            reception->add(s / RAY_CHUNK_SIZE, std::move(chunk));
+        }
+    });
+
+    if (reception != nullptr) {
+        reception->endLevel();
+    }
+
+    std::vector<int> live(amount_of_rays);
+    std::vector<char> alive(amount_of_rays);
+    for (int ray_i = 0; ray_i < amount_of_rays; ray_i++) {
+        live[ray_i] = ray_i;
+        alive[ray_i] = all_rays[ray_i].hit;
+    }
+
+    // paths that end clear their deeper slots, these missed everything at level 0
+    threadPool().parallelFor(0, amount_of_rays, RAY_CHUNK_SIZE, [&](int worker, int s, int e) {
+        for (int ray_i = s; ray_i < e; ray_i++) {
+            if (!alive[ray_i]) {
+                clearPath(all_rays, ray_settings, ray_i, 1);
+            }
+        }
+    });
+
+    // ray sorting needs the scene bounds of the bvh
+    bool sort_rays = SORT_RAYS && !ray_settings.bvh.empty();
+    Aabb bounds = sort_rays ? ray_settings.bvh.nodes.front().bounds : Aabb {};
+    std::vector<Ray> pending;
+    std::vector<std::pair<uint64_t, int>> order;
+
+    // every work item that receives fills its own sparse histograms, larger items keep their number down
+    int trace_chunk_size = reception != nullptr ? RAY_CHUNK_SIZE : WAVEFRONT_CHUNK_SIZE;
+
+    std::vector<int> next;
+    compactLive(live, alive, next);
+    live.swap(next);
+
+    for (int hit_level = 1; hit_level < ray_settings.max_hit_level && !live.empty(); hit_level++) {
+        std::cout << "\rWavefront level " << hit_level << ": " << live.size() << " rays" << std::flush;
+
+        int level_offset = amount_of_rays * hit_level;
+        int count = (int) live.size();
+        alive.assign(count, 0);
+        pending.resize(count);
+        order.resize(count);
+
+        // the reflections of the level first, so they can be reordered before any of them is traced
+        threadPool().parallelFor(0, count, WAVEFRONT_CHUNK_SIZE, [&](int worker, int s, int e) {
+            for (int i = s; i < e; i++) {
+                Ray &prevRay = all_rays[live[i] + level_offset - amount_of_rays];
+                std::optional<Ray> reflectedRay = createReflection(prevRay, hit_level);
+
+                alive[i] = reflectedRay.has_value();
+                if (reflectedRay.has_value()) {
+                    pending[i] = reflectedRay.value();
+                } else {
+                    clearPath(all_rays, ray_settings, live[i], hit_level);
+                }
+
+                order[i] = {sort_rays && alive[i] ? rayOrderKey(pending[i], bounds) : 0, i};
+            }
+        });
+
+        // neighbouring rays start close together in similar directions and traverse the same nodes
+        if (sort_rays) {
+            parallelSort(order);
+        }
+
+        if (reception != nullptr) {
+            reception->beginLevel((count + trace_chunk_size - 1) / trace_chunk_size);
+        }
+
+        // every ray is written back to its own index, so the order only changes the speed
+        threadPool().parallelFor(0, count, trace_chunk_size, [&](int worker, int s, int e) {
+            ReceptionChunk chunk;
+
+            for (int j = s; j < e; j++) {
+                int i = order[j].second;
+
+                if (!alive[i]) {
+                    continue;
+                }
+
+                Ray &reflectedRay = pending[i];
+                detectHit(reflectedRay, ray_settings);
+                if (reception != nullptr) {
+                    reception->receive(reflectedRay, ray_settings, chunk);
+                }
+                all_rays[live[i] + level_offset] = reflectedRay;
+                alive[i] = reflectedRay.hit;
+                if (!reflectedRay.hit) {
+                    clearPath(all_rays, ray_settings, live[i], hit_level + 1);
+                }
+            }
+
+            if (reception != nullptr) {
+                reception->add(s / trace_chunk_size, std::move(chunk));
+            }
+        });
+
+        if (reception != nullptr) {
+            reception->endLevel();
+        }
+
+        compactLive(live, alive, next);
+        live.swap(next);
+    }
+
+    if (reception != nullptr) {
+        reception->valid = true;
+    }
+
+    std::cout << std::endl;
+}
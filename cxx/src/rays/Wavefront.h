@@ -0,0 +1,14 @@
+#pragma once
+#include <vector>
+#include "Ray.h"
+
+
+// Breadth first alternative to castRay. Every hit level is traced for all live paths before the next one starts,
+// the paths that hit something are compacted into the live list of the next level with a parallel prefix sum.
+// Fills all_rays in the same layout and with the same rays as the depth first pass, index = rayIndex + amount_of_rays * hit_level.
+// With a reception every segment is received while it is still in cache, instead of in sweeps over all_rays afterwards.
+void traceWavefront(std::vector<Ray> &all_rays, glm::vec3 &startPoint, std::vector<StartingDirection> &directions,
+                    RaySettings &ray_settings, int seed, TraceReception *reception = nullptr);
+
+// Writes the entries of live whose flag in alive is set to compacted, in order.
+void compactLive(const std::vector<int> &live, const std::vector<char> &alive, std::vector<int> &compacted);
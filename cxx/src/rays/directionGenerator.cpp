@@ -3,13 +3,16 @@
 #include <config.h>
 #include "projections.h"
 #include "directionGenerator.h"
+#include "philox.h"
+#include "lowDiscrepancy.h"
 
 
-void GenerateDirections::generateDirections(std::vector<StartingDirection> &directions, int rays) {
-    for (int i = 0; i < rays; i++) {
-        std::uniform_real_distribution<> dis(0, 1.0);
+void GenerateDirections::generateDirections(std::vector<StartingDirection> &directions, int first_ray, int rays) {
+    for (int i = first_ray; i < first_ray + rays; i++) {
+        // bounce 0, reflections use their hit level
+        Philox random {(uint32_t) seed, (uint32_t) i, 0};
 
-        ProjectedCoords projectedCoords = {dis(generator), dis(generator)};
+        ProjectedCoords projectedCoords = sample2D((uint32_t) seed, (uint32_t) i, 0, random);
 
         glm::vec3 direction = getDirectionFrom2D(projectedCoords);
         StartingDirection startingDirection{
@@ -36,9 +39,16 @@ std::vector<StartingDirection> generateDirectionsFromCoords(std::vector<InitNums
 }
 
 
+DirectionSource uniformDirectionSource(int seed) {
+    return [seed](std::vector<StartingDirection> &directions, int first_ray, int count) {
+        directions.clear();
+        GenerateDirections{seed}.generateDirections(directions, first_ray, count);
+    };
+}
+
 std::vector<StartingDirection> GenerateDirections::generateDirections(int rays) {
     std::vector<StartingDirection> directions;
-    this->generateDirections(directions, rays);
+    this->generateDirections(directions, 0, rays);
     return directions;
 }
 
@@ -55,17 +65,21 @@ glm::vec3 getDirectionFrom2D(ProjectedCoords projectedCoords) {
     throw std::exception();
 }
 
-glm::vec3 GenerateDirections::getRandomDirection() {
-    std::uniform_real_distribution<> dis(0, 1.0);
+double getDirectionDensity(const glm::vec3 &direction) {
 
-    double x = dis(generator);
-    double y = dis(generator);
+    switch (global_config->PROJECTION_METHOD) {
+        case ZET_THETA:
+            return 1.0 / (4 * M_PI);
+        case EQUI_RECT:
+            // the area element of the sphere is cos(latitude) times that of the 2 pi by pi rectangle
+            return 1.0 / (2 * M_PI * M_PI * std::sqrt(std::max(1.0 - direction.z * direction.z, 1e-12)));
+    }
 
-    return getDirectionFrom2D({x, y});
+    std::cerr << "Invalid PROJECTION_METHODS chosen" << std::endl;
+    throw std::exception();
 }
 
 
-
 InitNums::InitNums() {
     this->probability = 1.0;
 }
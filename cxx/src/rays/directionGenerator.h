@@ -2,7 +2,7 @@
 #include <iostream>
 #include <vector>
 #include <glm/vec3.hpp>
-#include <random>
+#include <functional>
 #include "projections.h"
 #include "Coords.h"
 
@@ -23,25 +23,30 @@ struct StartingDirection {
     InitNums initNums;
 };
 
+// uniform starting directions, the direction of a ray only depends on the seed and its index
 class GenerateDirections {
 public:
     GenerateDirections(int seed) {
-        // https://en.cppreference.com/w/cpp/numeric/random/uniform_real_distribution
-        //  std::random_device rd;  //Will be used to obtain a seed for the random number engine
-        //  generator = std::mt19937(rd()); //Standard mersenne_twister_engine seeded with rd()
-        generator = std::mt19937(seed); //Standard mersenne_twister_engine seeded with rd()
+        this->seed = seed;
     }
 
     std::vector<StartingDirection> generateDirections(int rays);
-    void generateDirections(std::vector<StartingDirection> &directions, int rays);
-
-    glm::vec3 getRandomDirection();
+    // appends the directions of the rays [first_ray, first_ray + rays)
+    void generateDirections(std::vector<StartingDirection> &directions, int first_ray, int rays);
 
 private:
-    std::mt19937 generator;
+    int seed;
 };
 
 std::vector<StartingDirection> generateDirectionsFromCoords(std::vector<InitNums> projectedCoords);
+
+// fills directions with the starting directions of the rays [first_ray, first_ray + count), called with increasing first_ray
+using DirectionSource = std::function<void(std::vector<StartingDirection> &directions, int first_ray, int count)>;
+
+// the same directions as GenerateDirections{seed}.generateDirections(rays), produced in batches
+DirectionSource uniformDirectionSource(int seed);
 glm::vec3 getDirectionFrom2D(ProjectedCoords projectedCoords);
+// density per steradian of the directions of uniform projected coords
+double getDirectionDensity(const glm::vec3 &direction);
 
 
@@ -0,0 +1,122 @@
+#include <settings.h>
+#include <config.h>
+#include "lowDiscrepancy.h"
+
+// second key word of the scrambling streams, the streams of the rays use 0
+const uint32_t SOBOL_KEY = 1;
+const uint32_t STRATIFIED_KEY = 2;
+
+
+static uint32_t reverseBits(uint32_t x) {
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+// Laine and Karras' hash, every bit only depends on the bits below it
+static uint32_t laineKarrasPermutation(uint32_t x, uint32_t seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+// Burley, "Practical Hash-based Owen Scrambling"
+static uint32_t nestedUniformScramble(uint32_t x, uint32_t seed) {
+    return reverseBits(laineKarrasPermutation(reverseBits(x), seed));
+}
+
+// the first two Sobol dimensions, van der Corput and the one of the polynomial x + 1
+static uint32_t sobol(uint32_t index, int dimension) {
+    uint32_t result = 0;
+    uint32_t direction = 1u << 31;
+
+    for (; index != 0; index >>= 1) {
+        if (index & 1) {
+            result ^= direction;
+        }
+
+        direction = dimension == 0 ? direction >> 1 : direction ^ (direction >> 1);
+    }
+
+    return result;
+}
+
+static double toUnit(uint32_t x) {
+    return x * 0x1p-32;
+}
+
+// Kensler's hashed permutation of [0, length), "Correlated Multi-Jittered Sampling"
+static uint32_t permute(uint32_t i, uint32_t length, uint32_t p) {
+    uint32_t w = length - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+
+    do {
+        i ^= p;
+        i *= 0xe170893d;
+        i ^= p >> 16;
+        i ^= (i & w) >> 4;
+        i ^= p >> 8;
+        i *= 0x0929eb3f;
+        i ^= p >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | p >> 27;
+        i *= 0x6935fa69;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3df;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= length);
+
+    return (i + p) % length;
+}
+
+ProjectedCoords sobol2D(uint32_t seed, uint32_t index, uint32_t bounce) {
+    std::array<uint32_t, 4> scrambles = philox4x32({0, bounce, 0, 0}, {seed, SOBOL_KEY});
+
+    // shuffling the index decorrelates the bounces, which would otherwise all use point index of one sequence
+    uint32_t shuffled = nestedUniformScramble(index, scrambles[0]);
+
+    return {
+            toUnit(nestedUniformScramble(sobol(shuffled, 0), scrambles[1])),
+            toUnit(nestedUniformScramble(sobol(shuffled, 1), scrambles[2]))
+    };
+}
+
+ProjectedCoords stratified2D(uint32_t seed, uint32_t index, uint32_t bounce, Philox &random) {
+    const uint32_t cells = STRATIFIED_GRID * STRATIFIED_GRID;
+
+    // every run of cells indices visits the cells in its own order
+    uint32_t order = philox4x32({index / cells, bounce, 0, 0}, {seed, STRATIFIED_KEY})[0];
+    uint32_t cell = permute(index % cells, cells, order);
+
+    double x = (cell % STRATIFIED_GRID + random.uniform()) / STRATIFIED_GRID;
+    double y = (cell / STRATIFIED_GRID + random.uniform()) / STRATIFIED_GRID;
+    return {x, y};
+}
+
+ProjectedCoords sample2D(uint32_t seed, uint32_t index, uint32_t bounce, Philox &random) {
+    switch (global_config->SAMPLING_METHOD) {
+        case SOBOL_SAMPLING:
+            return sobol2D(seed, index, bounce);
+        case STRATIFIED_SAMPLING:
+            return stratified2D(seed, index, bounce, random);
+        case RANDOM_SAMPLING:
+            break;
+    }
+
+    double x = random.uniform();
+    return {x, random.uniform()};
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+#include "Coords.h"
+#include "philox.h"
+
+
+// Owen scrambled Sobol points, the index-th point of the sequence of (seed, bounce).
+// Every aligned run of 2^k indices is stratified, whichever seed and bounce.
+ProjectedCoords sobol2D(uint32_t seed, uint32_t index, uint32_t bounce);
+
+// a jittered STRATIFIED_GRID x STRATIFIED_GRID grid, every aligned run of STRATIFIED_GRID^2 indices has one point per cell
+ProjectedCoords stratified2D(uint32_t seed, uint32_t index, uint32_t bounce, Philox &random);
+
+// a point in [0, 1)^2 of the configured SAMPLING_METHOD, random is the stream of (seed, index, bounce)
+ProjectedCoords sample2D(uint32_t seed, uint32_t index, uint32_t bounce, Philox &random);
@@ -0,0 +1,49 @@
+#include "philox.h"
+
+const uint32_t PHILOX_M0 = 0xD2511F53;
+const uint32_t PHILOX_M1 = 0xCD9E8D57;
+const uint32_t PHILOX_W0 = 0x9E3779B9;
+const uint32_t PHILOX_W1 = 0xBB67AE85;
+const int PHILOX_ROUNDS = 10;
+
+
+std::array<uint32_t, 4> philox4x32(std::array<uint32_t, 4> counter, std::array<uint32_t, 2> key) {
+    for (int round = 0; round < PHILOX_ROUNDS; round++) {
+        uint64_t product_0 = (uint64_t) PHILOX_M0 * counter[0];
+        uint64_t product_1 = (uint64_t) PHILOX_M1 * counter[2];
+
+        counter = {
+                (uint32_t) (product_1 >> 32) ^ counter[1] ^ key[0],
+                (uint32_t) product_1,
+                (uint32_t) (product_0 >> 32) ^ counter[3] ^ key[1],
+                (uint32_t) product_0
+        };
+
+        key[0] += PHILOX_W0;
+        key[1] += PHILOX_W1;
+    }
+
+    return counter;
+}
+
+Philox::Philox(uint32_t seed, uint32_t ray, uint32_t bounce, uint32_t stream) {
+    // the last counter word numbers the blocks drawn from this stream
+    counter = {ray, bounce, stream, 0};
+    key = {seed, 0};
+}
+
+uint32_t Philox::next() {
+    if (used == 4) {
+        block = philox4x32(counter, key);
+        counter[3]++;
+        used = 0;
+    }
+
+    return block[used++];
+}
+
+double Philox::uniform() {
+    uint64_t high = next() >> 5;
+    uint64_t low = next() >> 6;
+    return (double) ((high << 26) | low) * (1.0 / 9007199254740992.0);
+}
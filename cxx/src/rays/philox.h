@@ -0,0 +1,26 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+
+// Philox4x32-10 counter based generator (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+// A stream is keyed by (seed, ray, bounce), so a ray draws the same numbers whichever thread or machine traces it,
+// and the state is 24 bytes instead of the 5 KB of an mt19937.
+class Philox {
+public:
+    // stream separates independent uses of the same bounce
+    Philox(uint32_t seed, uint32_t ray, uint32_t bounce, uint32_t stream = 0);
+
+    uint32_t next();
+
+    // uniform in [0, 1) with 53 random bits
+    double uniform();
+
+private:
+    std::array<uint32_t, 4> counter;
+    std::array<uint32_t, 2> key;
+    std::array<uint32_t, 4> block {};
+    int used = 4;
+};
+
+std::array<uint32_t, 4> philox4x32(std::array<uint32_t, 4> counter, std::array<uint32_t, 2> key);
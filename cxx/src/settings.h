@@ -39,13 +39,79 @@ const float SPEED_OF_SOUND = 343.0f;
 // ray tracing settings
 const float EPSILON = 1e-05;
 const int RANDOM_SEED = 42;
-const int NUM_THREADS = 8;
+const int NUM_THREADS = 0; // 0 starts one worker per hardware thread
+const int RAY_CHUNK_SIZE = 4096; // rays per work item of the thread pool
 const bool RANDOM_REFLECTION_RAYS = false;
 
+// acceleration structure
+const bool USE_BVH = true;
+#define TRIANGLE_PACKET_SIZE 8 // triangles intersected per simd call
+const int BVH_MAX_LEAF_SIZE = TRIANGLE_PACKET_SIZE;
+const int BVH_SAH_BINS = 12;
+const float BVH_SAH_TRAVERSAL_COST = 1.0f;
+const float BVH_SAH_INTERSECTION_COST = 1.0f;
+const int BVH_STACK_SIZE = 64;
+const int BVH_MAX_DEPTH = BVH_STACK_SIZE - 2;
+
+// binary scene cache next to the obj file, bump the version when its format changes
+const bool USE_SCENE_CACHE = true;
+const int SCENE_CACHE_VERSION = 1;
+
+// first bounce rays share the sender as origin and are traced in bundles
+const bool PACKET_TRACING = true;
+const int RAY_PACKET_SIZE = 32;
+
+// trace all rays one hit level at a time instead of one path at a time
+const bool WAVEFRONT_TRACING = true;
+const int WAVEFRONT_CHUNK_SIZE = 1024; // live rays per work item of a level
+// order the reflections of a level by origin and direction before tracing them, in sorted runs of RAY_SORT_RUN merged on the pool
+const bool SORT_RAYS = false;
+const int RAY_SORT_RUN = 1 << 14;
+// receive every segment of the stored pipeline right after it is traced instead of sweeping all_rays afterwards
+const bool FUSED_RECEPTION = true;
+
+// streaming mode, directions are generated and traced in batches of this many rays
+const int STREAMING_BATCH_RAYS = 1 << 18;
+
+// every thread deposits into its own sparse histogram, allocated per tile of this many samples when first touched
+const int HISTOGRAM_TILE_SAMPLES = 256;
+
 // importance sampling
 const bool ADJUST_ENERGY_WITH_PROBABILITY = true;
 const double MAX_PROBABILITY_FACTOR = 1;
 
+// gaussian mixture fitted to the projected coords of the receiver hits
+const int GMM_COMPONENTS = 40;
+const int GMM_KMEANS_ITERATIONS = 10; // lloyd iterations initialising the means
+const int GMM_MAX_ITERATIONS = 300;
+const double GMM_TOLERANCE = 1e-5; // stop once the mean log likelihood improves less than this
+const double GMM_REG_COVAR = 1e-6; // added to the covariance diagonal, keeps components of one hit invertible
+const int GMM_CHUNK_SIZE = 1024; // hits per work item of the e-step
+const bool GMM_WARM_START = true; // start EM of the next step from the current mixture instead of k-means
+const double GMM_HIT_DECAY = 0.5; // weight of the hits of earlier steps per step they age, 0 fits the latest hits only
+const double GMM_WRAP_SIGMAS = 6.0; // periodic images of a component further away than this add nothing to the pdf
+
+// tabulated proposal, a quadtree over the projected coords that is refined where the receiver hits are
+const int TABULATED_MAX_CELL_HITS = 64;
+const int TABULATED_MAX_DEPTH = 10;
+const double TABULATED_PSEUDO_HITS = 1.0; // spread uniformly over the domain so no cell has zero probability
+
+// image source method, the exact specular paths of the early reflection orders
+const float IMAGE_SOURCE_PLANE_TOLERANCE = 1e-3f; // triangles this close to one plane form one wall
+const float IMAGE_SOURCE_SURFACE_OFFSET = 1e-3f; // visibility checks start this far from a reflection point
+const int IMAGE_SOURCE_MAX_IMAGES = 1 << 20;
+const int IMAGE_SOURCE_CAP_SAMPLES = 32; // directions averaged over the receiver sphere, the density of a projection is not constant
+
+// reciprocal tracing, the candidate source spheres are binned in a uniform grid of at most this many cells
+const int SPHERE_GRID_MAX_CELLS = 1 << 21;
+
+// audience mode, the segments of this many rays are kept and then scored seat by seat
+const int AUDIENCE_BATCH_RAYS = 1 << 15;
+const int AUDIENCE_CHUNK_RAYS = 512; // rays per work item while tracing a batch
+
+// stratified sampling, the grid of cells each run of STRATIFIED_GRID^2 rays covers once
+const int STRATIFIED_GRID = 64;
+
 // projection methods
 enum PROJECTION_METHODS {
     ZET_THETA,
@@ -57,6 +123,30 @@ NLOHMANN_JSON_SERIALIZE_ENUM( PROJECTION_METHODS, {
     {EQUI_RECT, "EQUI_RECT"},
 })
 
+// importance sampling proposals
+enum PROPOSAL_METHODS {
+    GMM_PROPOSAL,
+    TABULATED_PROPOSAL
+};
+
+NLOHMANN_JSON_SERIALIZE_ENUM( PROPOSAL_METHODS, {
+    {GMM_PROPOSAL, "GMM"},
+    {TABULATED_PROPOSAL, "TABULATED"},
+})
+
+// how the initial and the random reflection directions are sampled
+enum SAMPLING_METHODS {
+    RANDOM_SAMPLING,
+    SOBOL_SAMPLING,
+    STRATIFIED_SAMPLING
+};
+
+NLOHMANN_JSON_SERIALIZE_ENUM( SAMPLING_METHODS, {
+    {RANDOM_SAMPLING, "RANDOM"},
+    {SOBOL_SAMPLING, "SOBOL"},
+    {STRATIFIED_SAMPLING, "STRATIFIED"},
+})
+
 // drawing settings
 const float RAY_TRANSPARENCY = 0.7;
 const float STANDARD_TRANSPARENCY = 0.0;